@@ -2,9 +2,11 @@
 
 // std includes
 #include <stdlib.h>
+#include <string.h>
 
 Array2D::Array2D() :
-  data_(NULL)
+  data_(NULL),
+  owned_(true)
 {
 
 }
@@ -12,22 +14,21 @@ Array2D::Array2D() :
 Array2D::Array2D(int xSize, int ySize) :
   xSize_(xSize),
   ySize_(ySize),
-  data_(NULL)
+  data_(NULL),
+  owned_(true)
 {
 
 }
 
 Array2D::~Array2D()
 {
-  if (data_ != NULL) {
-    free(data_);
-    data_ = NULL;
-  }
+  clear();
 }
 
 bool Array2D::init()
 {
   clear();
+  owned_ = true;
   data_ = (int*) calloc(xSize_ * ySize_, sizeof(int));
   if (data_ == NULL) {
     // Failed to allocate memory, abort nicely
@@ -43,12 +44,31 @@ bool Array2D::init(int xSize, int ySize)
   return init();
 }
 
+/*
+ * Uses storage, which someone else owns and which holds at least xSize * ySize
+ * values, instead of allocating. The values are left as they are.
+ * */
+bool Array2D::attach(int xSize, int ySize, int* storage)
+{
+  clear();
+  xSize_ = xSize;
+  ySize_ = ySize;
+  data_ = storage;
+  owned_ = false;
+  return data_ != NULL;
+}
+
 void Array2D::clear()
 {
-  if (data_ != NULL) {
+  if (data_ != NULL && owned_) {
     free(data_);
-    data_ = NULL;
   }
+  data_ = NULL;
+}
+
+void Array2D::zero()
+{
+  memset(data_, 0, sizeof(int) * xSize_ * ySize_);
 }
 
 int Array2D::get(int x, int y)
@@ -76,6 +96,11 @@ int Array2D::ySize()
   return ySize_;
 }
 
+int* Array2D::data()
+{
+  return data_;
+}
+
 int Array2D::offset(int x, int y)
 {
   return (y * xSize_) + x;
@@ -83,7 +108,8 @@ int Array2D::offset(int x, int y)
 
 
 Array3D::Array3D() :
-  data_(NULL)
+  data_(NULL),
+  owned_(true)
 {
 
 }
@@ -92,22 +118,21 @@ Array3D::Array3D(int xSize, int ySize, int zSize) :
   xSize_(xSize),
   ySize_(ySize),
   zSize_(zSize),
-  data_(NULL)
+  data_(NULL),
+  owned_(true)
 {
 
 }
 
 Array3D::~Array3D()
 {
-  if (data_ != NULL) {
-    free(data_);
-    data_ = NULL;
-  }
+  clear();
 }
 
 bool Array3D::init()
 {
   clear();
+  owned_ = true;
   data_ = (int*) calloc(xSize_ * ySize_ * zSize_, sizeof(int));
   if (data_ == NULL) {
     // Failed to allocate memory, abort nicely
@@ -124,12 +149,33 @@ bool Array3D::init(int xSize, int ySize, int zSize)
   return init();
 }
 
+/*
+ * Uses storage, which someone else owns and which holds at least
+ * xSize * ySize * zSize values, instead of allocating. The values are left
+ * as they are.
+ * */
+bool Array3D::attach(int xSize, int ySize, int zSize, int* storage)
+{
+  clear();
+  xSize_ = xSize;
+  ySize_ = ySize;
+  zSize_ = zSize;
+  data_ = storage;
+  owned_ = false;
+  return data_ != NULL;
+}
+
 void Array3D::clear()
 {
-  if (data_ != NULL) {
+  if (data_ != NULL && owned_) {
     free(data_);
-    data_ = NULL;
   }
+  data_ = NULL;
+}
+
+void Array3D::zero()
+{
+  memset(data_, 0, sizeof(int) * xSize_ * ySize_ * zSize_);
 }
 
 int Array3D::get(int x, int y, int z)
@@ -147,6 +193,11 @@ void Array3D::increment(int x, int y, int z)
   data_[offset(x, y, z)]++;
 }
 
+void Array3D::add(int x, int y, int z, int val)
+{
+  data_[offset(x, y, z)] += val;
+}
+
 int Array3D::xSize()
 {
   return xSize_;
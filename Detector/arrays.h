@@ -12,8 +12,10 @@ public:
 
   bool init();
   bool init(int xSize, int ySize);
+  bool attach(int xSize, int ySize, int* storage);
 
   void clear();
+  void zero();
 
   int get(int x, int y);
 
@@ -23,6 +25,8 @@ public:
   int xSize();
   int ySize();
 
+  int* data();
+
 private:
   int offset(int x, int y);
 
@@ -30,6 +34,7 @@ private:
   int xSize_;
   int ySize_;
   int* data_;
+  bool owned_;
 };
 
 
@@ -43,13 +48,16 @@ public:
 
   bool init();
   bool init(int xSize, int ySize, int zSize);
+  bool attach(int xSize, int ySize, int zSize, int* storage);
 
   void clear();
+  void zero();
 
   int get(int x, int y, int z);
 
   void set(int x, int y, int z, int val);
   void increment(int x, int y, int z);
+  void add(int x, int y, int z, int val);
 
   int xSize();
   int ySize();
@@ -63,6 +71,7 @@ private:
   int ySize_;
   int zSize_;
   int* data_;
+  bool owned_;
 };
 
 #endif // ARRAYS_H
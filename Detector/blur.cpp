@@ -0,0 +1,125 @@
+#include "blur.h"
+
+// System includes
+#include <math.h>
+#include <string.h>
+
+static int gaussianRadius(double sigma)
+{
+  int radius((int) ceil(3 * sigma));
+  return radius < 1 ? 1 : radius;
+}
+
+/*
+ * Fills the 2 * radius + 1 weights of the normalized one dimensional Gaussian,
+ * reaching three sigma to each side of the center, in fixed point.
+ * */
+static void buildKernel(double sigma, int radius, int32_t* weights)
+{
+  double total(0);
+  for (int i = -radius; i <= radius; ++i) {
+    total += exp(-(i * i) / (2 * sigma * sigma));
+  }
+  int32_t sum(0);
+  for (int i = -radius; i <= radius; ++i) {
+    weights[i + radius] = (int32_t) (exp(-(i * i) / (2 * sigma * sigma)) / total * (1 << gaussianWeightBits) + 0.5);
+    sum += weights[i + radius];
+  }
+  // Rounding leftovers go to the center, so flat areas stay exactly as they are
+  weights[radius] += (1 << gaussianWeightBits) - sum;
+}
+
+/*
+ * Blurs an 8 bit grayscale plane with stride bytes per row in place, using
+ * the Gaussian with the given sigma, repeating the outermost pixels beyond
+ * the borders.
+ *
+ * The kernel is separable, so the rows are blurred first, into a 16 bit
+ * plane with 8 extra bits of precision, and the columns of that plane after.
+ * The column pass adds whole rows at a time, and all inner loops run over
+ * plain arrays without branches, so the compiler can vectorize them. With
+ * 14 bit weights neither pass can overflow 32 bits.
+ *
+ * The buffers come from the workspace if one is given. Returns false if they
+ * could not be allocated, leaving the plane untouched.
+ * */
+bool gaussianBlurGray(uint8_t* gray, int width, int height, int stride, double sigma, Workspace* workspace)
+{
+  if (sigma <= 0 || width <= 0 || height <= 0) {
+    return true;
+  }
+
+  Workspace local;
+  if (workspace == 0) {
+    workspace = &local;
+  }
+
+  int radius(gaussianRadius(sigma));
+  size_t weightsBytes(Workspace::aligned(sizeof(int32_t) * (2 * radius + 1)));
+  size_t rowsBytes(Workspace::aligned(sizeof(uint16_t) * width * height));
+  size_t paddedBytes(Workspace::aligned(width + 2 * radius));
+  size_t sumsBytes(Workspace::aligned(sizeof(int32_t) * width));
+  char* scratch = (char*) workspace->buffer(Workspace::Blur, weightsBytes + rowsBytes + paddedBytes + sumsBytes);
+  if (scratch == NULL) {
+    return false;
+  }
+  int32_t* weights = (int32_t*) scratch;
+  uint16_t* rows = (uint16_t*) (scratch + weightsBytes);
+  uint8_t* padded = (uint8_t*) (scratch + weightsBytes + rowsBytes);
+  int32_t* sums = (int32_t*) (scratch + weightsBytes + rowsBytes + paddedBytes);
+
+  buildKernel(sigma, radius, weights);
+
+  const int rowShift(gaussianWeightBits - 8);
+  const int columnShift(gaussianWeightBits + 8);
+
+  uint8_t* line;
+  uint16_t* out;
+  for (int y = 0; y < height; ++y) {
+    line = gray + y * stride;
+    memset(padded, line[0], radius);
+    memcpy(padded + radius, line, width);
+    memset(padded + radius + width, line[width - 1], radius);
+
+    for (int x = 0; x < width; ++x) {
+      sums[x] = 0;
+    }
+    for (int k = 0; k <= 2 * radius; ++k) {
+      const uint8_t* shifted(padded + k);
+      int32_t weight(weights[k]);
+      for (int x = 0; x < width; ++x) {
+        sums[x] += shifted[x] * weight;
+      }
+    }
+    out = rows + y * width;
+    for (int x = 0; x < width; ++x) {
+      out[x] = (uint16_t) ((sums[x] + (1 << (rowShift - 1))) >> rowShift);
+    }
+  }
+
+  int row;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      sums[x] = 0;
+    }
+    for (int k = -radius; k <= radius; ++k) {
+      row = y + k;
+      if (row < 0) {
+        row = 0;
+      } else if (row >= height) {
+        row = height - 1;
+      }
+      const uint16_t* in(rows + row * width);
+      int32_t weight(weights[k + radius]);
+      for (int x = 0; x < width; ++x) {
+        sums[x] += in[x] * weight;
+      }
+    }
+    line = gray + y * stride;
+    for (int x = 0; x < width; ++x) {
+      line[x] = (uint8_t) ((sums[x] + (1 << (columnShift - 1))) >> columnShift);
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,15 @@
+#ifndef BLUR_H
+#define BLUR_H
+
+// System includes
+#include <stdint.h>
+
+// Detector includes
+#include "workspace.h"
+
+// Fixed point weights of the kernel sum up to 1 << gaussianWeightBits
+const int gaussianWeightBits = 14;
+
+bool gaussianBlurGray(uint8_t* gray, int width, int height, int stride, double sigma, Workspace* workspace = 0);
+
+#endif // BLUR_H
@@ -0,0 +1,199 @@
+#include "color_elimination.h"
+
+// System includes
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Fills threshold[v] with the smallest red value that is not below
+ * v * factor, using the same double comparison as the per pixel version
+ * did. A pixel is then non-red exactly when
+ *  red < greenThreshold[green] || red < blueThreshold[blue]
+ * */
+static void buildThresholds(double factor, int* threshold)
+{
+  int r;
+  for (int v = 0; v < 256; ++v) {
+    r = 0;
+    while (r < 256 && r < v * factor) {
+      r++;
+    }
+    threshold[v] = r;
+  }
+}
+
+/*
+ * Looks for a numerator and denominator below 128, so that for all 8 bit
+ * values red * denominator < v * numerator exactly when red < threshold[v].
+ * Both products then fit in signed 16 bit lanes.
+ * */
+static bool findRational(double factor, const int* threshold, int* numerator, int* denominator)
+{
+  if (!(factor >= 0 && factor < 127)) {
+    return false;
+  }
+
+  int ceiling;
+  bool matches;
+  for (int d = 1; d < 128; ++d) {
+    int nearest((int) (factor * d + 0.5));
+    for (int n = nearest - 1; n <= nearest + 1; ++n) {
+      if (n < 0 || n > 127) {
+        continue;
+      }
+      matches = true;
+      for (int v = 0; v < 256 && matches; ++v) {
+        ceiling = (v * n + d - 1) / d;
+        if (ceiling > 256) {
+          ceiling = 256;
+        }
+        matches = ceiling == threshold[v];
+      }
+      if (matches) {
+        *numerator = n;
+        *denominator = d;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/*
+ * Classifies pixels as non-red the same way as
+ *  red < green * greenfactor || red < blue * bluefactor
+ * */
+NonRedClassifier::NonRedClassifier(double greenfactor, double bluefactor)
+{
+  buildThresholds(greenfactor, greenThreshold_);
+  buildThresholds(bluefactor, blueThreshold_);
+  exact_ = findRational(greenfactor, greenThreshold_, &greenNumerator_, &greenDenominator_) &&
+      findRational(bluefactor, blueThreshold_, &blueNumerator_, &blueDenominator_);
+}
+
+/*
+ * Sets bits[x] to 1 for the non-red pixels of the row, and 0 for the others.
+ * */
+void NonRedClassifier::classifyRow(const uint32_t* line, int width, uint8_t* bits) const
+{
+  int x(0);
+#ifdef __SSE2__
+  if (exact_) {
+    const __m128i channel = _mm_set1_epi32(0xff);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i greenNumerator = _mm_set1_epi16(greenNumerator_);
+    const __m128i greenDenominator = _mm_set1_epi16(greenDenominator_);
+    const __m128i blueNumerator = _mm_set1_epi16(blueNumerator_);
+    const __m128i blueDenominator = _mm_set1_epi16(blueDenominator_);
+    __m128i p0, p1, red, green, blue, greener, bluer, nonRed;
+    for (; x + 8 <= width; x += 8) {
+      p0 = _mm_loadu_si128((const __m128i*) (line + x));
+      p1 = _mm_loadu_si128((const __m128i*) (line + x + 4));
+      red = _mm_packs_epi32(
+            _mm_and_si128(_mm_srli_epi32(p0, 16), channel),
+            _mm_and_si128(_mm_srli_epi32(p1, 16), channel));
+      green = _mm_packs_epi32(
+            _mm_and_si128(_mm_srli_epi32(p0, 8), channel),
+            _mm_and_si128(_mm_srli_epi32(p1, 8), channel));
+      blue = _mm_packs_epi32(
+            _mm_and_si128(p0, channel),
+            _mm_and_si128(p1, channel));
+      greener = _mm_cmpgt_epi16(_mm_mullo_epi16(green, greenNumerator), _mm_mullo_epi16(red, greenDenominator));
+      bluer = _mm_cmpgt_epi16(_mm_mullo_epi16(blue, blueNumerator), _mm_mullo_epi16(red, blueDenominator));
+      nonRed = _mm_and_si128(_mm_or_si128(greener, bluer), one);
+      _mm_storel_epi64((__m128i*) (bits + x), _mm_packus_epi16(nonRed, nonRed));
+    }
+  }
+#endif
+  uint32_t color;
+  int red;
+  for (; x < width; ++x) {
+    color = line[x];
+    red = (color >> 16) & 0xff;
+    bits[x] = (red < greenThreshold_[(color >> 8) & 0xff] || red < blueThreshold_[color & 0xff]) ? 1 : 0;
+  }
+}
+
+/*
+ * Blacks out the pixels where more than 3 of the 3x3 neighborhood are not
+ * red, leaving the outermost border as is. The pixels are 32 bit (A)RGB with
+ * stride pixels per row, and are modified in place.
+ *
+ * Each pixel is classified once, into a ring of three rows of non-red bits
+ * that is one row ahead of the pixels written, so the classification always
+ * sees the original colors. Column sums of the ring are kept running from
+ * row to row, and the three column sums around a pixel give its vote.
+ *
+ * If kept is given, it is filled with width * height flags, 1 for the
+ * pixels that were considered and left as they were. The row buffers come
+ * from the workspace if one is given. Returns false if they could not be
+ * allocated, leaving the pixels untouched.
+ * */
+bool eliminateColorsInPlace(
+    uint32_t* pixels,
+    int width,
+    int height,
+    int stride,
+    double greenfactor,
+    double bluefactor,
+    int* kept,
+    Workspace* workspace)
+{
+  if (kept != 0) {
+    memset(kept, 0, sizeof(int) * width * height);
+  }
+  if (width < 3 || height < 3) {
+    return true;
+  }
+
+  NonRedClassifier classifier(greenfactor, bluefactor);
+
+  Workspace local;
+  if (workspace == 0) {
+    workspace = &local;
+  }
+  uint8_t* buffer = (uint8_t*) workspace->buffer(Workspace::ColorRows, 4 * width);
+  if (buffer == NULL) {
+    return false;
+  }
+  // Row r of non-red bits is kept in bits[r % 3]
+  uint8_t* bits[3] = { buffer, buffer + width, buffer + 2 * width };
+  uint8_t* columnSum = buffer + 3 * width;
+
+  classifier.classifyRow(pixels, width, bits[0]);
+  classifier.classifyRow(pixels + stride, width, bits[1]);
+  for (int x = 0; x < width; ++x) {
+    columnSum[x] = bits[0][x] + bits[1][x];
+  }
+
+  uint8_t* entering;
+  uint32_t* line;
+  int removalVote;
+  for (int y = 1; y < height - 1; ++y) {
+    entering = bits[(y + 1) % 3];
+    if (y >= 2) {
+      // The slot still holds row y - 2, which leaves the neighborhood
+      for (int x = 0; x < width; ++x) {
+        columnSum[x] -= entering[x];
+      }
+    }
+    classifier.classifyRow(pixels + (y + 1) * stride, width, entering);
+    for (int x = 0; x < width; ++x) {
+      columnSum[x] += entering[x];
+    }
+
+    line = pixels + y * stride;
+    for (int x = 1; x < width - 1; ++x) {
+      removalVote = columnSum[x - 1] + columnSum[x] + columnSum[x + 1];
+      if (removalVote > 3) {
+        // Opaque black, as qRgb(0, 0, 0)
+        line[x] = 0xff000000u;
+      } else if (kept != 0) {
+        kept[y * width + x] = 1;
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,37 @@
+#ifndef COLOR_ELIMINATION_H
+#define COLOR_ELIMINATION_H
+
+// System includes
+#include <stdint.h>
+
+// Detector includes
+#include "workspace.h"
+
+class NonRedClassifier
+{
+public:
+  NonRedClassifier(double greenfactor, double bluefactor);
+
+  void classifyRow(const uint32_t* line, int width, uint8_t* bits) const;
+
+private:
+  int greenThreshold_[256];
+  int blueThreshold_[256];
+  bool exact_;
+  int greenNumerator_;
+  int greenDenominator_;
+  int blueNumerator_;
+  int blueDenominator_;
+};
+
+bool eliminateColorsInPlace(
+    uint32_t* pixels,
+    int width,
+    int height,
+    int stride,
+    double greenfactor,
+    double bluefactor,
+    int* kept = 0,
+    Workspace* workspace = 0);
+
+#endif // COLOR_ELIMINATION_H
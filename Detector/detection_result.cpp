@@ -0,0 +1,11 @@
+#include "detection_result.h"
+
+DetectionResult::DetectionResult() :
+  speed_(SpeedClasses::NoSpeed),
+  speedConfidence_(0),
+  located_(false),
+  classified_(false),
+  partial_(false)
+{
+
+}
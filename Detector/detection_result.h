@@ -0,0 +1,32 @@
+#ifndef DETECTION_RESULT_H
+#define DETECTION_RESULT_H
+
+// Detector includes
+#include "detection.h"
+#include "speed_classes.h"
+
+/*
+ * Best available outcome of a detection run that was given a deadline.
+ *
+ * A result can be located but not classified, meaning the sign position
+ * is known but there was no time left to compare all speed classes. In
+ * that case speed_ holds the best speed among the classes that were
+ * compared, if any. A result is partial when a stage was cut short by the
+ * deadline, so one that is neither located nor partial found no sign.
+ * */
+class DetectionResult
+{
+public:
+  DetectionResult();
+
+public:
+  Detection sign_;
+  SpeedClasses::Speed speed_;
+  double speedConfidence_;
+
+  bool located_;
+  bool classified_;
+  bool partial_;
+};
+
+#endif // DETECTION_RESULT_H
@@ -2,16 +2,28 @@
 #define DETECTOR_H
 
 // Qt Includes
+#include <QObject>
 #include <QString>
 #include <QImage>
-#include <QMultiMap>
-#include <QElapsedTimer>
+#include <QSharedPointer>
 
 // Detector Includes
-#include "arrays.h"
 #include "detection.h"
-
-class Detector : public QObject
+#include "detector_context.h"
+#include "detector_listener.h"
+#include "frame_view.h"
+#include "model.h"
+#include "sign_track.h"
+#include "speed_classes.h"
+
+// Forward declarations
+class DetectionResult;
+class TraceRecorder;
+
+/*
+ * A DetectorContext with its own model, that reports through signals.
+ * */
+class Detector : public QObject, public SpeedClasses, public DetectorListener
 {
   Q_OBJECT
 
@@ -19,39 +31,78 @@ public:
   Detector();
   Detector(QString file);
 
-  enum Speed { NoSpeed, Thirty, Forty, Fifty, Sixty, Seventy, Eighty, Ninety, Hundred, HundredTen, HundredTwenty };
   void initialize();
 
+  DetectorContext* context();
+  void setModel(QSharedPointer<const Model> model);
+  QSharedPointer<const Model> model() const;
+  bool loadModel(QString file);
+  bool saveModel(QString file);
+  QByteArray trainingSetHash(QString trainingFolder);
+
   void setEdgeThreshold(double threshold);
   void setHarrisThreshold(double threshold);
+  void setRTablePruning(int maxBinSize, double mergeDistance);
+  void setDensityFilter(double minEdgeDensity, double minRedDensity);
+  void setRedProposals(bool redProposals);
+  void setPreprocessThreads(int threads);
+  void setBlurSigma(double sigma);
+  void setTrainingThreads(int threads);
+  void setTracking(int fullSearchInterval);
+  void setChangeTolerance(int tolerance);
+  void setTiledDetection(int tileSize, int signs = 1);
+  int minimumTileSize();
+  void setTraceRecorder(TraceRecorder* trace);
 
   void loadImage();
   void loadImage(QString file);
+  void setImage(QImage image);
+  void loadFrame(const uchar* data, int width, int height, int stride, FrameView::Format format);
+  void releaseFrame();
 
-  QPixmap getPixmap();
-  QPixmap getSobelAnglePixmap();
+  QImage image();
+  QImage sobelAngleImage();
 
   QRect getImageSize();
 
-  void blurred();
+  void blurred(double sigma = 1.1);
+  void preprocess(bool colorElimination);
   void sobelEdges();
   void edgeThinning();
   void harrisCorners();
 
   void train(QString trainingFolder);
   void trainHarris(QString trainingFolder);
+  void trainClass(Speed speed, QString trainingFolder);
   void detect(bool colorElimination);
   void detectHarris(bool colorElimination);
+  DetectionResult detectWithin(bool colorElimination, qint64 budget);
+  void detectTracked(bool colorElimination);
+  QList<SignTrack> tracks() const;
+  void resetTracks();
+  void detectIncremental(bool colorElimination);
+  void resetIncremental();
+  void detectTiled(bool colorElimination);
 
   void generateRTable(Speed speed);
+  int rTableEntries();
+  qint64 votesCast();
+  void resetVotesCast();
 
   QList<Detection> findNoSpeedObject(int numberObjects = 10);
   QMap<Speed, double> detectSpeed(Detection detection);
 
   void eliminateColors(double greenfactor, double bluefactor);
+  QList<QRect> proposeRedRegions(double greenfactor, double bluefactor);
 
   QRgb getColor(QPoint point);
 
+  void onMessage(QString message);
+  void onVerboseMessage(QString message);
+  void onTiming(QString message);
+  void onItemFound(QRect position, int confidence, int order);
+  void onSpeedFound(QRect position, double confidence, SpeedClasses::Speed speed);
+
 signals:
   void issueMessage(QString message);
   void issueVerboseMessage(QString message);
@@ -59,35 +110,11 @@ signals:
   void itemFound(QRect position, int confidence, int order);
   void speedFound(QRect position, double confidence, Detector::Speed speed);
 
-
-private:
-  int interpolate(int a, int b, int progress);
-  void issueTimingMessage(QString message);
-  void issuePartialTimingMessage(QString message);
-
-  void checkNeighborPixel(bool isEdge, bool *currentlyEdge, int *n, int *s);
-  QList<Detection> findObject(int numberObjects, double scalingMin, double scalingMax, int nScalings, QMultiMap<int, QPair<double, double> > rTable, QRect detectionArea);
-
 public:
   QMap<Speed, QString> speeds_;
 
 private:
-  QString file_;
-  QImage img_;
-  Array2D sobelAngles_;
-  QMap<Speed, QMultiMap<int, QPair<double, double> > > rTables_;
-  QMap<Speed, QSize> trainingSize_;
-
-  double edgeThreshold_;
-  double harrisThreshold_;
-
-  QSize imgSize_;
-
-  double signMaxSize_;
-  double signMinSize_;
-  double numberScalings_;
-
-  QElapsedTimer timer_;
+  DetectorContext context_;
 };
 
 #endif // DETECTOR_H
@@ -0,0 +1,2624 @@
+#include "detector_context.h"
+
+//Qt includes
+#include <QRgb>
+#include <QImageReader>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QPointF>
+#include <QThreadPool>
+#include <QThread>
+#include <qmath.h>
+#include <QDebug>
+
+// Detector includes
+#include "math_utilities.h"
+#include "color_elimination.h"
+#include "blur.h"
+#include "downscale.h"
+#include "preprocessing.h"
+#include "preprocess_task.h"
+#include "training_task.h"
+#include "detection.h"
+#include "detection_result.h"
+#include "model_file.h"
+#include "trace_recorder.h"
+
+// System includes
+#include <string.h>
+
+DetectorContext::DetectorContext() :
+  listener_(NULL),
+  model_(new Model())
+{
+}
+
+DetectorContext::DetectorContext(QString file) :
+  listener_(NULL),
+  model_(new Model()),
+  file_(file)
+{
+}
+
+void DetectorContext::initialize()
+{
+  edgeThreshold_ = 50;
+  harrisThreshold_ = 10000000;
+  rTableMaxBinSize_ = 0;
+  rTableMergeDistance_ = 0;
+  votesCast_ = 0;
+  edgeCount_ = 0;
+  minEdgeDensity_ = 0;
+  minRedDensity_ = 0;
+  redPixelsValid_ = false;
+  redProposals_ = false;
+  proposalsValid_ = false;
+  preprocessThreads_ = 1;
+  trainingThreads_ = QThread::idealThreadCount();
+  frameData_ = NULL;
+  blurSigma_ = 0;
+  imgSize_ = QSize(600, 600);
+  signMaxSize_ = qRound(imgSize_.width() * 0.1);
+  signMinSize_ = qRound(imgSize_.width() * 0.03);
+  numberScalings_ = 20;
+  partialMark_ = 0;
+  trace_ = NULL;
+
+  deadline_ = -1;
+  searchInterrupted_ = false;
+  lastSpeed_ = NoSpeed;
+
+  fullSearchInterval_ = 10;
+  framesSinceFullSearch_ = 0;
+
+  incrementalValid_ = false;
+  incrementalColors_ = false;
+  incrementalEdgeCount_ = -1;
+  incrementalModel_ = NULL;
+  changeTolerance_ = 0;
+
+  tileSize_ = 0;
+  tileSigns_ = 1;
+  origin_ = QPoint();
+
+  speeds_ = names();
+}
+
+/*
+ * Sets who gets the messages and findings, NULL to keep quiet.
+ * */
+void DetectorContext::setListener(DetectorListener* listener)
+{
+  listener_ = listener;
+}
+
+/*
+ * Detects with the given model from now on. Edges are found with the
+ * thresholds the model was trained with, unless the model is still empty.
+ * */
+void DetectorContext::setModel(QSharedPointer<const Model> model)
+{
+  model_ = model;
+  if (!model_->isEmpty()) {
+    edgeThreshold_ = model_->info().edgeThreshold_;
+    harrisThreshold_ = model_->info().harrisThreshold_;
+  }
+}
+
+/*
+ * Loads a model saved with saveModel(), instead of training. Returns false,
+ * keeping the current model, if the file can not be used.
+ * */
+bool DetectorContext::loadModel(QString file)
+{
+  startTiming();
+  QString error;
+  QSharedPointer<const Model> model(ModelFile::load(file, &error));
+  if (model.isNull()) {
+    issueMessage(error);
+    return false;
+  }
+  setModel(model);
+  issueVerboseMessage(QString("Loaded %1 R-table entries").arg(model_->entries()));
+  issueTimingMessage("Load model");
+  return true;
+}
+
+bool DetectorContext::saveModel(QString file)
+{
+  startTiming();
+  QString error;
+  if (!ModelFile::save(*model_, file, &error)) {
+    issueMessage(error);
+    return false;
+  }
+  issueTimingMessage("Save model");
+  return true;
+}
+
+/*
+ * Hashes the names and contents of the training images in trainingFolder,
+ * so a saved model can be told apart from one trained on other images.
+ * */
+QByteArray DetectorContext::trainingSetHash(QString trainingFolder)
+{
+  QCryptographicHash hash(QCryptographicHash::Sha256);
+  QString imgFilePath;
+  foreach (Speed s, speeds_.keys()) {
+    imgFilePath = "training-" + speeds_.value(s) + ".png";
+    hash.addData(imgFilePath.toUtf8());
+    QFile imgFile(trainingFolder + imgFilePath);
+    if (imgFile.open(QIODevice::ReadOnly)) {
+      hash.addData(imgFile.readAll());
+    }
+  }
+  return hash.result();
+}
+
+TrainingInfo DetectorContext::trainingInfo(TrainingInfo::Mode mode, QString trainingFolder)
+{
+  TrainingInfo info;
+  info.mode_ = mode;
+  info.edgeThreshold_ = edgeThreshold_;
+  info.harrisThreshold_ = harrisThreshold_;
+  info.rTableMaxBinSize_ = rTableMaxBinSize_;
+  info.rTableMergeDistance_ = rTableMergeDistance_;
+  info.trainingSetHash_ = trainingSetHash(trainingFolder);
+  return info;
+}
+
+QSharedPointer<const Model> DetectorContext::model() const
+{
+  return model_;
+}
+
+void DetectorContext::setEdgeThreshold(double threshold)
+{
+  edgeThreshold_ = threshold;
+  incrementalValid_ = false;
+}
+
+void DetectorContext::setHarrisThreshold(double threshold)
+{
+  harrisThreshold_ = threshold;
+}
+
+/*
+ * Limits the size of the R-tables built by generateRTable() from now on.
+ *
+ * Entries in an angle bin whose displacement vectors fall within the same
+ * mergeDistance sized cell are merged into their mean, and bins still holding
+ * more than maxBinSize entries are subsampled evenly around the shape.
+ * Zero disables the respective step.
+ * */
+void DetectorContext::setRTablePruning(int maxBinSize, double mergeDistance)
+{
+  rTableMaxBinSize_ = maxBinSize;
+  rTableMergeDistance_ = mergeDistance;
+}
+
+/*
+ * Restricts the sign search to windows of the candidate sign sizes holding
+ * enough edge pixels, or after color elimination enough red pixels, to
+ * plausibly contain a sign. Only edge pixels inside such a window vote.
+ *
+ * The edge density is relative to the circumference of a sign filling the
+ * window, the red density relative to the window area. Zero disables the
+ * respective check.
+ * */
+void DetectorContext::setDensityFilter(double minEdgeDensity, double minRedDensity)
+{
+  minEdgeDensity_ = minEdgeDensity;
+  minRedDensity_ = minRedDensity;
+}
+
+/*
+ * Limits the sign search to the surroundings of red regions of sign size,
+ * found before color elimination and edge detection.
+ * */
+void DetectorContext::setRedProposals(bool redProposals)
+{
+  redProposals_ = redProposals;
+}
+
+/*
+ * Sets the number of threads, including the calling one, that preprocess()
+ * spreads its tiles over.
+ * */
+void DetectorContext::setPreprocessThreads(int threads)
+{
+  preprocessThreads_ = qMax(threads, 1);
+}
+
+/*
+ * Sets the number of threads, including the calling one, that train() and
+ * trainHarris() spread the sign classes over.
+ * */
+void DetectorContext::setTrainingThreads(int threads)
+{
+  trainingThreads_ = qMax(threads, 1);
+}
+
+/*
+ * Makes detectTracked() search the whole frame for new signs at least every
+ * fullSearchInterval frames, and follow the known ones in between.
+ * */
+void DetectorContext::setTracking(int fullSearchInterval)
+{
+  fullSearchInterval_ = qMax(fullSearchInterval, 1);
+}
+
+/*
+ * Makes detectIncremental() treat a tile as unchanged as long as no channel
+ * of its pixels moved more than tolerance levels away, 0 for exact equality.
+ * */
+void DetectorContext::setChangeTolerance(int tolerance)
+{
+  changeTolerance_ = qMax(tolerance, 0);
+}
+
+/*
+ * Keeps images at their full size instead of shrinking them to imgSize_, for
+ * detectTiled() to look for up to signs signs in tiles of tileSize pixels.
+ * A tileSize of 0 shrinks images again.
+ * */
+void DetectorContext::setTiledDetection(int tileSize, int signs)
+{
+  tileSize_ = qMax(tileSize, 0);
+  tileSigns_ = qMax(signs, 1);
+}
+
+/*
+ * The smallest tiles detectTiled() searches, those that hold the enlarged
+ * box of the smallest sign twice.
+ * */
+int DetectorContext::minimumTileSize()
+{
+  return 2 * qCeil(1.2 * signMinSize_);
+}
+
+/*
+ * Adds each timed step, and each part of one, to the trace, NULL to stop
+ * tracing. The recorder is shared with the contexts the settings are copied
+ * to, and must outlive them.
+ * */
+void DetectorContext::setTraceRecorder(TraceRecorder* trace)
+{
+  trace_ = trace;
+}
+
+/*
+ * Takes over the settings of another context, not its image or model.
+ * */
+void DetectorContext::copySettings(const DetectorContext& other)
+{
+  edgeThreshold_ = other.edgeThreshold_;
+  harrisThreshold_ = other.harrisThreshold_;
+  rTableMaxBinSize_ = other.rTableMaxBinSize_;
+  rTableMergeDistance_ = other.rTableMergeDistance_;
+  minEdgeDensity_ = other.minEdgeDensity_;
+  minRedDensity_ = other.minRedDensity_;
+  redProposals_ = other.redProposals_;
+  preprocessThreads_ = other.preprocessThreads_;
+  trainingThreads_ = other.trainingThreads_;
+  blurSigma_ = other.blurSigma_;
+  fullSearchInterval_ = other.fullSearchInterval_;
+  changeTolerance_ = other.changeTolerance_;
+  tileSize_ = other.tileSize_;
+  tileSigns_ = other.tileSigns_;
+  trace_ = other.trace_;
+}
+
+/*
+ * Blurs the color eliminated image with a Gaussian of the given sigma before
+ * the edges are detected, 0 disables blurring.
+ * */
+void DetectorContext::setBlurSigma(double sigma)
+{
+  blurSigma_ = qMax(sigma, 0.0);
+}
+
+/*
+ * Loads the image and shrinks it to fit imgSize_. Codecs that can decode at
+ * a reduced size, like JPEG at 1/2, 1/4 and 1/8, are asked for the smallest
+ * of those sizes that is still at least as large as needed, which saves most
+ * of the decoding of large photos. The rest of the way is averaged down by
+ * fitImage(). With tiled detection the image is loaded at its full size.
+ * */
+void DetectorContext::loadImage()
+{
+  startTiming();
+  redPixelsValid_ = false;
+  proposalsValid_ = false;
+  edgeCount_ = 0;
+
+  replaceImage(QImage());
+  frameData_ = NULL;
+
+  QImageReader reader(file_);
+  QSize size(reader.size());
+  sourceSize_ = size;
+  if (tileSize_ <= 0 && size.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+    QSize fitted(size.scaled(imgSize_, Qt::KeepAspectRatio));
+    int factor(1);
+    while (factor < 8 &&
+           size.width() / (2 * factor) >= fitted.width() &&
+           size.height() / (2 * factor) >= fitted.height()) {
+      factor *= 2;
+    }
+    if (factor > 1) {
+      // Rounded up, the same way the JPEG decoder does
+      reader.setScaledSize(QSize((size.width() + factor - 1) / factor, (size.height() + factor - 1) / factor));
+      issueVerboseMessage(QString("Decoding at 1/%1 size").arg(factor));
+    }
+  }
+  // Codecs decode into the previous image when it has the same size and format
+  const uchar* previous(decoded_.constBits());
+  if (!reader.read(&decoded_)) {
+    decoded_ = QImage();
+  } else if (decoded_.constBits() != previous) {
+    workspace_.countAllocation();
+  }
+  img_ = decoded_;
+  if (!sourceSize_.isValid()) {
+    sourceSize_ = img_.size();
+  }
+  issueTimingMessage("Decode image");
+
+  fitImage();
+
+  issueVerboseMessage(QString("Loaded image with size: (%1, %2)").arg(img_.width()).arg(img_.height()));
+}
+
+void DetectorContext::loadImage(QString file)
+{
+  file_ = file;
+  loadImage();
+}
+
+void DetectorContext::setImage(QImage image)
+{
+  startTiming();
+  redPixelsValid_ = false;
+  proposalsValid_ = false;
+  edgeCount_ = 0;
+
+  replaceImage(image);
+  frameData_ = NULL;
+  sourceSize_ = img_.size();
+  issueTimingMessage("Set image");
+
+  fitImage();
+}
+
+/*
+ * Uses the caller's frame as the image, without copying it. The frame must
+ * stay valid and unchanged until the next image is loaded or releaseFrame()
+ * is called. Stages that change the image in place work on a copy, and
+ * frames larger than imgSize_ are only read to shrink them.
+ *
+ * For Nv12 only the luma plane is used, and gray frames skip the color
+ * elimination of preprocess().
+ * */
+void DetectorContext::loadFrame(const uchar* data, int width, int height, int stride, FrameView::Format format)
+{
+  startTiming();
+  redPixelsValid_ = false;
+  proposalsValid_ = false;
+  edgeCount_ = 0;
+
+  QImage frame;
+  switch (format) {
+  case FrameView::Argb32:
+    frame = QImage(data, width, height, stride, QImage::Format_RGB32);
+    break;
+  case FrameView::Rgba32:
+    frame = QImage(data, width, height, stride, QImage::Format_RGBA8888);
+    break;
+  case FrameView::Rgb24:
+    frame = QImage(data, width, height, stride, QImage::Format_RGB888);
+    break;
+  case FrameView::Bgr24:
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    frame = QImage(data, width, height, stride, QImage::Format_BGR888);
+#else
+    // No such QImage format before Qt 5.14, convert once
+    frame = QImage(data, width, height, stride, QImage::Format_RGB888).rgbSwapped();
+    workspace_.countAllocation();
+#endif
+    break;
+  case FrameView::Gray8:
+  case FrameView::Nv12:
+    frame = QImage(data, width, height, stride, QImage::Format_Grayscale8);
+    break;
+  }
+  replaceImage(frame);
+  frameData_ = data;
+  sourceSize_ = img_.size();
+  issueTimingMessage("Load frame");
+
+  fitImage();
+
+  issueVerboseMessage(QString("Loaded frame with size: (%1, %2)").arg(img_.width()).arg(img_.height()));
+}
+
+/*
+ * Stops using the frame given to loadFrame(), copying the image if it still
+ * is the frame itself.
+ * */
+void DetectorContext::releaseFrame()
+{
+  if (frameData_ != NULL && img_.constBits() == frameData_) {
+    img_ = img_.copy();
+  }
+  frameData_ = NULL;
+}
+
+/*
+ * Returns a view on the pixels of the image, converting the image only if
+ * its format can not be read directly.
+ * */
+FrameView DetectorContext::frameView()
+{
+  FrameView::Format format;
+  switch (img_.format()) {
+  case QImage::Format_RGB32:
+  case QImage::Format_ARGB32:
+    format = FrameView::Argb32;
+    break;
+  case QImage::Format_RGBX8888:
+  case QImage::Format_RGBA8888:
+    format = FrameView::Rgba32;
+    break;
+  case QImage::Format_RGB888:
+    format = FrameView::Rgb24;
+    break;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+  case QImage::Format_BGR888:
+    format = FrameView::Bgr24;
+    break;
+#endif
+  case QImage::Format_Grayscale8:
+    format = FrameView::Gray8;
+    break;
+  default:
+    img_ = img_.convertToFormat(QImage::Format_RGB32);
+    format = FrameView::Argb32;
+    break;
+  }
+  return FrameView(img_.constBits(), img_.width(), img_.height(), img_.bytesPerLine(), format);
+}
+
+/*
+ * Replaces the image. The buffer of the previous one is kept for the edges of
+ * the next, unless it is a frame given to loadFrame().
+ * */
+void DetectorContext::replaceImage(QImage image)
+{
+  if (frameData_ == NULL || img_.constBits() != frameData_) {
+    edges_ = img_;
+  }
+  img_ = image;
+}
+
+/*
+ * Makes the image a view on the pixels of tile in frameImage, which must be
+ * kept while the tile is used. Nothing is copied, unless a stage changes the
+ * image in place.
+ * */
+void DetectorContext::useTile(const QImage& frameImage, QRect tile)
+{
+  redPixelsValid_ = false;
+  proposalsValid_ = false;
+  replaceImage(QImage(
+                 frameImage.constBits() + tile.y() * frameImage.bytesPerLine() + tile.x() * frameImage.depth() / 8,
+                 tile.width(),
+                 tile.height(),
+                 frameImage.bytesPerLine(),
+                 frameImage.format()));
+}
+
+/*
+ * Makes image an RGB32 image of the given size that shares its pixels with
+ * no other image, keeping its buffer if it already is one.
+ * */
+bool DetectorContext::reuseImage(QImage* image, QSize size)
+{
+  if (image->size() != size || image->format() != QImage::Format_RGB32 || !image->isDetached()) {
+    *image = QImage(size, QImage::Format_RGB32);
+    workspace_.countAllocation();
+  }
+  return !image->isNull();
+}
+
+/*
+ * Returns the pixels of the image to change them in place. Counts the copy
+ * that is made when the image still shares them, or is a caller's frame.
+ * */
+uchar* DetectorContext::writableBits()
+{
+  if (!img_.isDetached() || img_.constBits() == frameData_) {
+    workspace_.countAllocation();
+  }
+  return img_.bits();
+}
+
+/*
+ * Shrinks the image to fit imgSize_, keeping the aspect ratio, by averaging
+ * the area each new pixel covers. Smaller images are left as they are, and
+ * so are all images with tiled detection.
+ * */
+void DetectorContext::fitImage()
+{
+  if (tileSize_ > 0 || (img_.width() <= imgSize_.width() && img_.height() <= imgSize_.height())) {
+    return;
+  }
+  startTiming();
+
+  QSize size(img_.size().scaled(imgSize_, Qt::KeepAspectRatio));
+  size = size.expandedTo(QSize(1, 1));
+  if (!reuseImage(&fitted_, size) || !downscaleArea(
+        frameView(),
+        (uint32_t*) fitted_.bits(),
+        fitted_.width(),
+        fitted_.height(),
+        fitted_.bytesPerLine() / 4,
+        &workspace_)) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the resized image in DetectorContext::fitImage.");
+    timer_.invalidate();
+    return;
+  }
+
+  img_ = fitted_;
+  issueTimingMessage("Resize image");
+}
+
+QImage DetectorContext::image()
+{
+  return img_;
+}
+
+QImage DetectorContext::sobelAngleImage()
+{
+  int width(sobelAngles_.xSize());
+  int height(sobelAngles_.ySize());
+
+  QImage angleImage(width, height, QImage::Format_RGB32);
+  int color;
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      color = sobelAngles_.get(x, y);
+      angleImage.setPixel(x, y, qRgb(color, color, color));
+    }
+  }
+  return angleImage;
+}
+
+QRect DetectorContext::getImageSize()
+{
+  return img_.rect();
+}
+
+/*
+ * The size of the image as it was loaded, before fitImage() shrank it.
+ * */
+QSize DetectorContext::sourceSize()
+{
+  return sourceSize_;
+}
+
+/*
+ * The number of edge pixels in the image once the edges are thinned, summed
+ * over the tiles with tiled detection, 0 before and in Harris mode. Edges
+ * are only counted with a trace recorder, as the count is only traced.
+ * */
+int DetectorContext::edgeCount()
+{
+  return edgeCount_;
+}
+
+/*
+ * The number of pixels in area that are not black.
+ * */
+int DetectorContext::countEdges(const QImage& edges, QRect area)
+{
+  area = area.intersected(edges.rect());
+  if (edges.depth() != 32 || area.isEmpty()) {
+    return 0;
+  }
+  int count(0);
+  const QRgb* line;
+  for (int y = area.top(); y <= area.bottom(); ++y) {
+    line = (const QRgb*) edges.constScanLine(y);
+    for (int x = area.left(); x <= area.right(); ++x) {
+      if ((line[x] & 0xffffff) != 0) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+/*
+ * Replaces the image by its blurred grayscale version. Only the gray values
+ * are used by the edge detection, so only those are blurred.
+ * */
+void DetectorContext::blurred(double sigma)
+{
+  startTiming();
+
+  if (img_.format() != QImage::Format_RGB32 && img_.format() != QImage::Format_ARGB32) {
+    img_ = img_.convertToFormat(QImage::Format_RGB32);
+  }
+
+  int width(img_.width());
+  int height(img_.height());
+
+  uint8_t* gray = (uint8_t*) workspace_.buffer(Workspace::GrayPlane, width * height);
+  if (gray == NULL) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the gray plane in DetectorContext::blurred.");
+    timer_.invalidate();
+    return;
+  }
+
+  const QRgb* line;
+  for (int y = 0; y < height; ++y) {
+    line = (const QRgb*) img_.constScanLine(y);
+    for (int x = 0; x < width; ++x) {
+      gray[y * width + x] = qGray(line[x]);
+    }
+  }
+
+  if (!gaussianBlurGray(gray, width, height, width, sigma, &workspace_)) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the blur in DetectorContext::blurred.");
+    timer_.invalidate();
+    return;
+  }
+
+  uchar* bits(writableBits());
+  int bytesPerLine(img_.bytesPerLine());
+  QRgb* out;
+  for (int y = 0; y < height; ++y) {
+    out = (QRgb*) (bits + y * bytesPerLine);
+    for (int x = 0; x < width; ++x) {
+      out[x] = qRgb(gray[y * width + x], gray[y * width + x], gray[y * width + x]);
+    }
+  }
+  issueTimingMessage("Blur");
+}
+
+/*
+ * Same as eliminateColors(1, 1.2), if colorElimination is set, followed by
+ * sobelEdges(), but in a single pass over the image. The image is processed
+ * in tiles small enough to stay in the cache through all steps, and rows of
+ * tiles are spread over the preprocessing threads.
+ *
+ * With a blur sigma set, the blur needs the whole color eliminated image, so
+ * color elimination and blur run as separate passes before the tiled Sobel.
+ * */
+void DetectorContext::preprocess(bool colorElimination)
+{
+  bool blur(blurSigma_ > 0);
+  if (blur) {
+    redPixelsValid_ = false;
+    if (colorElimination) {
+      eliminateColors(1, 1.2);
+    }
+    blurred(blurSigma_);
+  }
+
+  startTiming();
+
+  FrameView frame(frameView());
+  // Without colors there is nothing to tell red from
+  colorElimination = colorElimination && frame.hasColor();
+
+  int width(img_.width());
+  int height(img_.height());
+
+  // Every pixel gets its edge and angle written, no need to clear them first
+  if (!reuseImage(&edges_, img_.size()) ||
+      !sobelAngles_.attach(width, height, workspace_.ints(Workspace::SobelAngles, width * height))) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the sobelAngles_ in DetectorContext::preprocess.");
+    timer_.invalidate();
+    return;
+  }
+
+  // Remember the remaining red pixels for the density filter
+  if (!blur) {
+    redPixelsValid_ = colorElimination && minRedDensity_ > 0 &&
+        redPixels_.attach(width, height, workspace_.ints(Workspace::RedPixels, width * height));
+    if (redPixelsValid_) {
+      redPixels_.zero();
+    }
+  }
+
+  NonRedClassifier classifier(1, 1.2);
+
+  PreprocessJob job;
+  job.frame_ = frame;
+  job.classifier_ = colorElimination && !blur ? &classifier : NULL;
+  job.edgeThreshold_ = edgeThreshold_;
+  job.edges_ = (uint32_t*) edges_.bits();
+  job.edgeStride_ = edges_.bytesPerLine() / 4;
+  job.angles_ = sobelAngles_.data();
+  job.kept_ = redPixelsValid_ && !blur ? redPixels_.data() : NULL;
+
+  QSharedPointer<TileRowQueue> queue(new TileRowQueue(job));
+  for (int i = 1; i < preprocessThreads_; ++i) {
+    QThreadPool::globalInstance()->start(new PreprocessTask(queue));
+  }
+  queue->work();
+  queue->waitUntilDone();
+
+  // The image alone holds the edges, so thinning them does not copy
+  img_ = edges_;
+  edges_ = QImage();
+  issueTimingMessage("Preprocessing");
+}
+
+void DetectorContext::sobelEdges()
+{
+  startTiming();
+  // Sobel masks
+  int gX[3][3] = {
+      {-1, 0, 1},
+      {-2, 0, 2},
+      {-1, 0, 1}
+    };
+
+  int gY[3][3] = {
+    {1, 2, 1},
+    {0, 0, 0},
+    {-1, -2, -1}
+  };
+
+  QImage res(img_.size(), QImage::Format_RGB32);
+
+  int width(img_.width());
+  int height(img_.height());
+
+  if (!sobelAngles_.init(width, height)) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the sobelAngles_ in DetectorContext::sobelEdges.");
+    timer_.invalidate();
+    return;
+  }
+
+  int i, j;
+  long sumX, sumY;
+  int sum;
+  int angle;
+  uint color;
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      // Make outermost border black, so we can have an easier/faster for loop below
+      if( y <= 0 || y >= height - 1 || x <= 0 || x >= width - 1 ) {
+        sum = 0;
+        angle = 0;
+      } else {
+        sumX = 0;
+        sumY = 0;
+        for ( i = -1; i <= 1; i++) {
+          for (j = -1; j <= 1; j++) {
+           color = img_.pixel(x + i, y + j);
+           sumX += qGray(color) * gX[i + 1][j + 1];
+           sumY += qGray(color) * gY[i + 1][j + 1];
+          }
+        }
+        sum = qAbs(sumX) + qAbs(sumY);
+        sum = qMin(sum, 255);
+        double phi = atan2upperHalfPlane(sumY, sumX);
+        // Angle is between 0 and 180 degrees, where 0 is E/W, 45 is NE/SW and 90 is N/S
+        angle = qRound(qRadiansToDegrees(phi));
+      }
+      if (sum < edgeThreshold_) {
+        sum = 0;
+      }
+      res.setPixel(x, y, qRgb(sum, sum, sum));
+      sobelAngles_.set(x, y, angle);
+    }
+  }
+  img_ = res;
+  issueTimingMessage("Edge detection");
+}
+
+void DetectorContext::harrisCorners()
+{
+  startTiming();
+  // Sobel masks
+  int gX[3][3] = {
+      {-1, 0, 1},
+      {-2, 0, 2},
+      {-1, 0, 1}
+    };
+
+  int gY[3][3] = {
+    {1, 2, 1},
+    {0, 0, 0},
+    {-1, -2, -1}
+  };
+
+  QImage res(img_.size(), QImage::Format_RGB32);
+
+  int width(img_.width());
+  int height(img_.height());
+
+  if (!sobelAngles_.init(width, height)) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the harrisCorners_ in DetectorContext::harrisCorners.");
+    timer_.invalidate();
+    return;
+  }
+
+  int i, j;
+  long sumX, sumY;
+  int sum;
+  uint color;
+
+  double phi;
+  int angle;
+
+  double r;
+  double ix2, iy2, ixy, sx2, sy2, sxy;
+  double detH;
+  double kTraceH2;
+  double k(0.05);
+
+  issueVerboseMessage(QString("Harris threshold is: %1").arg(harrisThreshold_));
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      // Make outermost border black, so we can have an easier/faster for loop below
+      if( y <= 0 || y >= height - 1 || x <= 0 || x >= width - 1 ) {
+        r = 0;
+      } else {
+        sumX = 0;
+        sumY = 0;
+        for ( i = -1; i <= 1; i++) {
+          for (j = -1; j <= 1; j++) {
+           color = img_.pixel(x + i, y + j);
+           sumX += qGray(color) * gX[i + 1][j + 1];
+           sumY += qGray(color) * gY[i + 1][j + 1];
+          }
+        }
+        // Compute angle/gradient
+        sum = qAbs(sumX) + qAbs(sumY);
+        sum = qMin(sum, 255);
+        phi = atan2upperHalfPlane(sumY, sumX);
+        // Angle is between 0 and 180 degrees, where 0 is E/W, 45 is NE/SW and 90 is N/S
+        angle = qRound(qRadiansToDegrees(phi));
+
+        // Harris corner algorithm description from
+        // http://www.cse.psu.edu/~rtc12/CSE486/lecture06.pdf
+        ix2 = sumX * sumX;
+        iy2 = sumY * sumY;
+        ixy = sumX * sumY;
+        // Using simplified version without windowing
+        sx2 = ix2;
+        sy2 = iy2;
+        sxy = ixy;
+        detH = sx2 * sy2 - sxy * sxy;
+        kTraceH2 = k * (sx2 + sy2) * (sx2 + sy2);
+        r = qAbs(qRound(detH - kTraceH2));
+        if (r < harrisThreshold_) {
+          r = 0;
+        } else {
+          r = 255;
+        }
+      }
+      res.setPixel(x, y, qRgb(r, r, r));
+      sobelAngles_.set(x, y, angle);
+    }
+  }
+  img_ = res;
+  issueTimingMessage("Harris corners");
+}
+
+void DetectorContext::train(QString trainingFolder) {
+  issueVerboseMessage("Training...");
+  trainAll(TrainingInfo::Edge, trainingFolder);
+}
+
+void DetectorContext::trainHarris(QString trainingFolder) {
+  issueVerboseMessage("Training using Harris corners...");
+  trainAll(TrainingInfo::Harris, trainingFolder);
+}
+
+/*
+ * Trains one sign class on its image in trainingFolder, adding its R-table
+ * to the model or replacing the one there, and keeps the R-tables of the
+ * other classes. The class is trained in the mode of the model, and the
+ * training set hash is brought up to date.
+ * */
+void DetectorContext::trainClass(Speed speed, QString trainingFolder)
+{
+  if (model_->isEmpty()) {
+    model_ = QSharedPointer<const Model>(new Model(
+          QMap<Speed, RTable>(), QMap<Speed, QSize>(), trainingInfo(model_->info().mode_, trainingFolder)));
+  }
+  trainClassImage(speed, trainingFolder);
+
+  TrainingInfo info(model_->info());
+  info.trainingSetHash_ = trainingSetHash(trainingFolder);
+  model_ = QSharedPointer<const Model>(new Model(model_->withInfo(info)));
+}
+
+/*
+ * Trains every sign class in a context of its own, spread over the thread
+ * pool. The classes do not depend on each other, so the model is the same as
+ * when training them one after another, and the messages are passed on in
+ * the same order too.
+ * */
+void DetectorContext::trainAll(TrainingInfo::Mode mode, QString trainingFolder)
+{
+  QElapsedTimer trainingTimer;
+  trainingTimer.start();
+
+  Model model(QMap<Speed, RTable>(), QMap<Speed, QSize>(), trainingInfo(mode, trainingFolder));
+  QSharedPointer<const Model> emptyModel(new Model(model));
+
+  QList<Speed> speeds(speeds_.keys());
+  QList<QSharedPointer<DetectorContext> > contexts;
+  QList<QSharedPointer<MessageBuffer> > buffers;
+  QList<DetectorContext*> queued;
+  for (int i = 0; i < speeds.size(); ++i) {
+    contexts.append(QSharedPointer<DetectorContext>(new DetectorContext()));
+    buffers.append(QSharedPointer<MessageBuffer>(new MessageBuffer()));
+    contexts.last()->initialize();
+    contexts.last()->copySettings(*this);
+    contexts.last()->setModel(emptyModel);
+    contexts.last()->setListener(buffers.last().data());
+    queued.append(contexts.last().data());
+  }
+
+  QSharedPointer<TrainingQueue> queue(new TrainingQueue(queued, speeds, trainingFolder));
+  int threads(qMin(trainingThreads_, speeds.size()));
+  for (int i = 1; i < threads; ++i) {
+    QThreadPool::globalInstance()->start(new TrainingTask(queue));
+  }
+  queue->work();
+  queue->waitUntilDone();
+
+  for (int i = 0; i < speeds.size(); ++i) {
+    buffers.at(i)->replay(listener_);
+    QSharedPointer<const Model> trained(contexts.at(i)->model());
+    if (trained->contains(speeds.at(i))) {
+      model = model.withClass(speeds.at(i), trained->rTable(speeds.at(i)), trained->trainingSize(speeds.at(i)));
+    }
+  }
+  model_ = QSharedPointer<const Model>(new Model(model));
+
+  issueTiming(QString("Training on %1 threads: %2 ms").arg(threads).arg(trainingTimer.elapsed()));
+}
+
+/*
+ * Loads the training image of one sign class, finds its edges or corners as
+ * the mode of the model says, and puts its R-table into the model.
+ * */
+void DetectorContext::trainClassImage(Speed speed, QString trainingFolder)
+{
+  QString imgFilePath(trainingFolder + "training-" + speeds_.value(speed) + ".png");
+  issueMessage(QString("Loading training image %1").arg(imgFilePath));
+  // Training images are shrunk to imgSize_ even with tiled detection
+  int tileSize(tileSize_);
+  tileSize_ = 0;
+  loadImage(imgFilePath);
+  tileSize_ = tileSize;
+  if (model_->info().mode_ == TrainingInfo::Harris) {
+    harrisCorners();
+  } else {
+    sobelEdges();
+    edgeThinning();
+  }
+  generateRTable(speed);
+}
+
+void DetectorContext::detect(bool colorElimination)
+{
+  issueVerboseMessage("Detecting...");
+  if (redProposals_) {
+    proposeRedRegions(1, 1.2);
+  }
+  if (colorElimination) {
+    issueVerboseMessage("Eliminating colors...");
+  }
+  preprocess(colorElimination);
+  edgeThinning();
+  QList<Detection> noSpeedDetections = findNoSpeedObject(1);
+  foreach (Detection d, noSpeedDetections) {
+    // Nothing was located, like when there are no red regions
+    if (d.confidence_ > 0) {
+      detectSpeed(d);
+    }
+  }
+  issueAllocationMessage();
+}
+
+void DetectorContext::detectHarris(bool colorElimination)
+{
+  issueVerboseMessage("Detecting...");
+  if (redProposals_) {
+    proposeRedRegions(1, 1.2);
+  }
+  if (colorElimination) {
+    issueVerboseMessage("Eliminating colors...");
+    eliminateColors(1, 1.2);
+  }
+  if (blurSigma_ > 0) {
+    blurred(blurSigma_);
+  }
+  harrisCorners();
+  QList<Detection> noSpeedDetections = findNoSpeedObject(1);
+  foreach (Detection d, noSpeedDetections) {
+    if (d.confidence_ > 0) {
+      detectSpeed(d);
+    }
+  }
+  issueAllocationMessage();
+}
+
+/*
+ * Runs the edge detection pipeline, but gives up on the remaining stages once
+ * budget milliseconds have passed, returning the best result available by then.
+ *
+ * The stages are ordered by priority: edges and the sign location come first,
+ * since without them there is nothing to return. Edge thinning stops after the
+ * current pass once it used half of the budget left to it, so voting always
+ * gets the other half. Voting stops after the current row and the peaks found
+ * in the votes cast so far are used. The speed classes are compared last,
+ * starting with the speed found in the previous call, and any class that
+ * could not be compared completely is left out of the result. The result is
+ * only partial when a stage was cut short, so finding no sign in time is not.
+ * A negative budget means no deadline at all.
+ * */
+DetectionResult DetectorContext::detectWithin(bool colorElimination, qint64 budget)
+{
+  issueVerboseMessage(QString("Detecting within %1 ms...").arg(budget));
+  deadlineTimer_.start();
+  deadline_ = budget;
+  searchInterrupted_ = false;
+
+  DetectionResult result;
+  if (redProposals_) {
+    proposeRedRegions(1, 1.2);
+  }
+  if (colorElimination) {
+    issueVerboseMessage("Eliminating colors...");
+  }
+  preprocess(colorElimination);
+
+  // Nothing can be located without the edges
+  bool locationInterrupted(deadlineReached());
+  if (!locationInterrupted) {
+    // Thinning may take half of what is left, so the votes get the rest
+    qint64 elapsed(deadlineTimer_.elapsed());
+    deadline_ = budget < 0 ? -1 : elapsed + (budget - elapsed) / 2;
+    edgeThinning();
+    locationInterrupted = searchInterrupted_;
+    deadline_ = budget;
+
+    QList<Detection> noSpeedDetections = findNoSpeedObject(1);
+    if (!noSpeedDetections.isEmpty() && noSpeedDetections.first().confidence_ > 0) {
+      result.sign_ = noSpeedDetections.first();
+      result.located_ = true;
+    }
+    locationInterrupted = locationInterrupted || searchInterrupted_;
+  }
+
+  if (result.located_ && !deadlineReached()) {
+    QMap<Speed, double> speedMap = detectSpeed(result.sign_);
+    foreach (Speed speed, speedMap.keys()) {
+      if (speedMap.value(speed) > result.speedConfidence_) {
+        result.speedConfidence_ = speedMap.value(speed);
+        result.speed_ = speed;
+      }
+    }
+    // All classes except NoSpeed are compared
+    result.classified_ = speedMap.size() == model_->speeds().size() - 1;
+  }
+
+  if (result.classified_) {
+    lastSpeed_ = result.speed_;
+  }
+  result.partial_ = locationInterrupted || (result.located_ && !result.classified_);
+
+  issueVerboseMessage(QString("Detection %1 after %2 ms.").arg(
+                        result.partial_ ? "partial" : "complete").arg(
+                        deadlineTimer_.elapsed()));
+
+  deadline_ = -1;
+  deadlineTimer_.invalidate();
+  issueAllocationMessage();
+  return result;
+}
+
+/*
+ * Detects in the next frame of a video, following the signs found in the
+ * frames before instead of searching the whole frame for them.
+ *
+ * Each track is looked for only in a window around where its last movement
+ * predicts it, at scalings close to the one it was found at. Its speed is
+ * taken over from the frame before, until the sign is found with clearly less
+ * confidence than when it was classified. The whole frame is still searched
+ * every fullSearchInterval frames to pick up new signs, and as soon as a
+ * track is lost. Tracks that are neither followed nor found again by such a
+ * search are dropped.
+ * */
+void DetectorContext::detectTracked(bool colorElimination)
+{
+  issueVerboseMessage("Detecting with tracking...");
+  framesSinceFullSearch_++;
+  bool fullSearch(tracks_.isEmpty() || framesSinceFullSearch_ >= fullSearchInterval_);
+  if (fullSearch && redProposals_) {
+    proposeRedRegions(1, 1.2);
+  }
+  if (colorElimination) {
+    issueVerboseMessage("Eliminating colors...");
+  }
+  preprocess(colorElimination);
+  edgeThinning();
+
+  QVector<bool> followed(tracks_.size(), false);
+  for (int i = 0; i < tracks_.size(); ++i) {
+    followed[i] = followTrack(&tracks_[i]);
+    if (!followed[i] && !fullSearch) {
+      issueMessage("Lost track of a sign, searching the whole frame.");
+      fullSearch = true;
+    }
+  }
+
+  if (fullSearch) {
+    framesSinceFullSearch_ = 0;
+    QList<Detection> noSpeedDetections = findNoSpeedObject(1);
+    if (!noSpeedDetections.isEmpty() && noSpeedDetections.first().confidence_ > 0) {
+      Detection found(noSpeedDetections.first());
+      double confidence((double)found.confidence_/model_->rTable(NoSpeed).size());
+
+      // A sign found again belongs to the track whose box it mostly covers
+      int match(-1);
+      QRect overlap;
+      for (int i = 0; i < tracks_.size() && match < 0; ++i) {
+        overlap = tracks_.at(i).box_.intersected(found.box_);
+        if (2 * overlap.width() * overlap.height() > tracks_.at(i).box_.width() * tracks_.at(i).box_.height()) {
+          match = i;
+        }
+      }
+      if (match < 0) {
+        tracks_.append(SignTrack());
+        followed.append(false);
+        match = tracks_.size() - 1;
+        tracks_[match].box_ = found.box_;
+      }
+      if (!followed.at(match)) {
+        tracks_[match].update(found.box_, confidence);
+        tracks_[match].foundConfidence_ = confidence;
+        classifyTrack(&tracks_[match]);
+        followed[match] = true;
+      }
+    }
+  }
+
+  for (int i = tracks_.size() - 1; i >= 0; --i) {
+    if (!followed.at(i)) {
+      tracks_.removeAt(i);
+    }
+  }
+  issueVerboseMessage(QString("Following %1 signs.").arg(tracks_.size()));
+  issueAllocationMessage();
+}
+
+QList<SignTrack> DetectorContext::tracks() const
+{
+  return tracks_;
+}
+
+/*
+ * Forgets the signs followed so far, for a new video.
+ * */
+void DetectorContext::resetTracks()
+{
+  tracks_.clear();
+  framesSinceFullSearch_ = 0;
+}
+
+/*
+ * Looks for the sign of the track in the window it is predicted in, and
+ * reports it. Returns false, leaving the track as it was, if the sign is
+ * found with less than half the confidence of the full search that found it.
+ * */
+bool DetectorContext::followTrack(SignTrack* track)
+{
+  startTiming();
+
+  double margin(0.5);
+  double lowerScalingFactor(0.9);
+  double upperScalingFactor(1.1);
+  int numberScalings(5);
+  double lossRatio(0.5);
+
+  QRect window(track->predicted(margin));
+  double scaling((double)track->box_.width()/model_->trainingSize(NoSpeed).width());
+  issueVerboseMessage(QString("Following sign in (%1,%2) -> (%3,%4).").arg(
+                        window.left()).arg(window.top()).arg(window.right()).arg(window.bottom()));
+
+  QList<Detection> maxList = findObject(
+        1,
+        lowerScalingFactor * scaling,
+        upperScalingFactor * scaling,
+        numberScalings,
+        model_->rTable(NoSpeed),
+        window);
+  issueTimingMessage("Sign tracking");
+  if (maxList.isEmpty()) {
+    return false;
+  }
+
+  double confidence((double)maxList.first().confidence_/model_->rTable(NoSpeed).size());
+  if (confidence < lossRatio * track->foundConfidence_) {
+    return false;
+  }
+
+  track->update(maxList.first().box_, confidence);
+  classifyTrack(track);
+  return true;
+}
+
+/*
+ * Compares the speed classes at the box of the track, unless the sign is
+ * still found with at least 0.8 times the confidence it had when it was
+ * last classified, in which case that speed is reported again.
+ * */
+void DetectorContext::classifyTrack(SignTrack* track)
+{
+  double reclassifyRatio(0.8);
+
+  if (track->speed_ != NoSpeed && track->confidence_ >= reclassifyRatio * track->classifiedConfidence_) {
+    issueVerboseMessage(QString("Keeping speed %1 of the sign followed.").arg(speeds_.value(track->speed_)));
+    issueSpeedFound(track->box_, track->speedConfidence_, track->speed_);
+    return;
+  }
+
+  QMap<Speed, double> speedMap = detectSpeed(Detection(track->box_, 0));
+  track->speed_ = NoSpeed;
+  track->speedConfidence_ = 0;
+  foreach (Speed speed, speedMap.keys()) {
+    if (speedMap.value(speed) > track->speedConfidence_) {
+      track->speedConfidence_ = speedMap.value(speed);
+      track->speed_ = speed;
+    }
+  }
+  track->classifiedConfidence_ = track->confidence_;
+}
+
+/*
+ * Detects in the next frame of a video from a camera that barely moves, like
+ * detect(), but only redoes the work for the tiles that changed since the
+ * previous frame.
+ *
+ * The edges, their angles and the votes of the NoSpeed R-table for the whole
+ * frame are kept from frame to frame. For a changed tile and a few pixels
+ * around it, the votes of the old edges are taken back, the edges are found
+ * and thinned again, and the new edges vote. Thinning near the border of such
+ * a region sees the thinned edges around it instead of unthinned ones, so the
+ * edges can differ slightly from those detect() finds.
+ *
+ * Blurring, the density filters and the red proposals depend on the whole
+ * frame, with any of them on this simply runs detect().
+ * */
+void DetectorContext::detectIncremental(bool colorElimination)
+{
+  if (blurSigma_ > 0 || minEdgeDensity_ > 0 || minRedDensity_ > 0 || redProposals_) {
+    issueVerboseMessage("Blurring, density filters and red proposals need the whole frame, detecting it all.");
+    detect(colorElimination);
+    return;
+  }
+
+  issueVerboseMessage("Detecting incrementally...");
+  if (colorElimination) {
+    issueVerboseMessage("Eliminating colors...");
+  }
+  if (!updateEdges(colorElimination)) {
+    return;
+  }
+
+  startTiming();
+  int nScalings(numberScalings_);
+  double scalingMin(signMinSize_/model_->trainingSize(NoSpeed).width());
+  double scalingMax(signMaxSize_/model_->trainingSize(NoSpeed).width());
+  double scalingStep((scalingMax - scalingMin)/(nScalings - 1));
+  QList<Detection> noSpeedDetections = isolateMaxima(
+        1,
+        &incrementalVotes_,
+        0,
+        0,
+        img_.width() - 1,
+        img_.height() - 1,
+        scalingMin,
+        scalingStep,
+        nScalings);
+  issueTimingMessage("Sign detection");
+
+  foreach (Detection d, noSpeedDetections) {
+    if (d.confidence_ > 0) {
+      detectSpeed(d);
+    }
+  }
+  issueAllocationMessage();
+}
+
+/*
+ * Makes the next detectIncremental() start over from the whole frame.
+ * */
+void DetectorContext::resetIncremental()
+{
+  incrementalValid_ = false;
+}
+
+/*
+ * Where the tiles of tileSize pixels start along a side of length pixels,
+ * step pixels apart, with the last one ending at the end of the side.
+ * */
+static QList<int> tileStarts(int length, int tileSize, int step)
+{
+  QList<int> starts;
+  int start(0);
+  while (start + tileSize < length) {
+    starts << start;
+    start += step;
+  }
+  starts << qMax(length - tileSize, 0);
+  return starts;
+}
+
+/*
+ * Whether the boxes overlap by more than half of the smaller one.
+ * */
+static bool mostlyOverlap(QRect a, QRect b)
+{
+  QRect overlap(a.intersected(b));
+  int smaller(qMin(a.width() * a.height(), b.width() * b.height()));
+  return 2 * overlap.width() * overlap.height() > smaller;
+}
+
+/*
+ * Detects in the image at its full size, loaded with tiled detection on, so
+ * small signs far away are not lost by shrinking it to imgSize_.
+ *
+ * The image is searched one square tile at a time, as if each was an image
+ * of its own, so the buffers and the accumulator only ever hold a tile and
+ * memory does not grow with the image. The smallest sign looked for keeps
+ * its size in pixels, the largest grows with the image, so signs take up
+ * the same part of it as in the shrunk image, but only as far as a tile
+ * holds it. Tiles overlap by more than the largest sign, so every sign is
+ * whole in at least one of them.
+ *
+ * The best location of each tile is a candidate. A sign on a seam is found
+ * by the tiles on both sides, so candidates that mostly overlap a better one
+ * are dropped, as are those with less than half the votes of the best. The
+ * speeds are then compared for up to tileSigns_ candidates left, and their
+ * positions are reported in the whole image. The image is left as it was.
+ * */
+void DetectorContext::detectTiled(bool colorElimination)
+{
+  issueVerboseMessage("Detecting in tiles...");
+  if (tileSize_ < minimumTileSize()) {
+    issueMessage(QString("Tiles of %1 pixels can not hold signs of %2 pixels, use tiles of at least %3 pixels.").arg(
+                   tileSize_).arg(
+                   signMinSize_).arg(
+                   minimumTileSize()));
+    return;
+  }
+  if (colorElimination) {
+    issueVerboseMessage("Eliminating colors...");
+  }
+
+  // Only the pixels of the image are read, as long as frameImage holds them
+  frameView();
+  QImage frameImage(img_);
+  int width(frameImage.width());
+  int height(frameImage.height());
+
+  // Room for the enlarged box the speeds are compared in, with tiles that
+  // still move on by at least half their size
+  double scale(qMax(1.0, qMax((double)width / imgSize_.width(), (double)height / imgSize_.height())));
+  double signMaxSize(signMaxSize_);
+  signMaxSize_ = qMax(signMinSize_, qMin(signMaxSize * scale, (tileSize_ / 2) / 1.2));
+  int overlap(qCeil(1.2 * signMaxSize_));
+  int tileSize(tileSize_);
+  QList<QRect> tiles;
+  foreach (int y, tileStarts(height, tileSize, tileSize - overlap)) {
+    foreach (int x, tileStarts(width, tileSize, tileSize - overlap)) {
+      tiles.append(QRect(x, y, qMin(tileSize, width), qMin(tileSize, height)));
+    }
+  }
+  issueVerboseMessage(QString("Searching %1 tiles of %2x%2 for signs of %3 to %4 pixels.").arg(
+                        tiles.size()).arg(
+                        tileSize).arg(
+                        signMinSize_).arg(
+                        signMaxSize_));
+
+  QList<Detection> candidates;
+  QList<int> candidateTiles;
+  int edges(0);
+  for (int i = 0; i < tiles.size(); ++i) {
+    useTile(frameImage, tiles.at(i));
+    if (redProposals_) {
+      proposeRedRegions(1, 1.2);
+    }
+    preprocess(colorElimination);
+    edgeThinning();
+    edges += edgeCount_;
+    QList<Detection> noSpeedDetections = findNoSpeedObject(1);
+    if (!noSpeedDetections.isEmpty() && noSpeedDetections.first().confidence_ > 0) {
+      candidates.append(Detection(noSpeedDetections.first().box_.translated(tiles.at(i).topLeft()),
+                                  noSpeedDetections.first().confidence_));
+      candidateTiles.append(i);
+    }
+  }
+
+  QList<int> kept;
+  QVector<bool> taken(candidates.size(), false);
+  while (kept.size() < tileSigns_) {
+    int next(-1);
+    for (int i = 0; i < candidates.size(); ++i) {
+      if (!taken.at(i) && (next < 0 || candidates.at(i).confidence_ > candidates.at(next).confidence_)) {
+        next = i;
+      }
+    }
+    if (next < 0 || (!kept.isEmpty() && 2 * candidates.at(next).confidence_ < candidates.at(kept.first()).confidence_)) {
+      break;
+    }
+    taken[next] = true;
+    bool duplicate(false);
+    foreach (int k, kept) {
+      duplicate = duplicate || mostlyOverlap(candidates.at(next).box_, candidates.at(k).box_);
+    }
+    if (!duplicate) {
+      kept.append(next);
+    }
+  }
+  issueVerboseMessage(QString("Kept %1 of %2 candidates.").arg(kept.size()).arg(candidates.size()));
+
+  // The edges of the last tile are still there
+  int prepared(tiles.size() - 1);
+  foreach (int k, kept) {
+    int tile(candidateTiles.at(k));
+    if (tile != prepared) {
+      useTile(frameImage, tiles.at(tile));
+      preprocess(colorElimination);
+      edgeThinning();
+      prepared = tile;
+    }
+    origin_ = tiles.at(tile).topLeft();
+    detectSpeed(Detection(candidates.at(k).box_.translated(-origin_), candidates.at(k).confidence_));
+    origin_ = QPoint();
+  }
+
+  signMaxSize_ = signMaxSize;
+  replaceImage(frameImage);
+  edgeCount_ = edges;
+  issueAllocationMessage();
+}
+
+/*
+ * Brings the thinned edges, their angles and the NoSpeed votes up to date
+ * with the image, which then holds the edges like after edgeThinning().
+ * Everything is redone the first time, and after the image size, the model,
+ * the edge threshold or the color elimination changed.
+ * */
+bool DetectorContext::updateEdges(bool colorElimination)
+{
+  startTiming();
+
+  FrameView frame(frameView());
+  colorElimination = colorElimination && frame.hasColor();
+  // The frame may be the image itself, keep it while the image becomes the edges
+  QImage frameImage(img_);
+  img_ = QImage();
+
+  int width(frameImage.width());
+  int height(frameImage.height());
+  int nScalings(numberScalings_);
+  bool restart(!incrementalValid_ ||
+               incrementalEdges_.size() != frameImage.size() ||
+               incrementalColors_ != colorElimination ||
+               incrementalModel_ != model_.data());
+
+  uint32_t* reference((uint32_t*) workspace_.ints(Workspace::ReferenceFrame, width * height));
+  uchar* mask((uchar*) workspace_.buffer(Workspace::ChangeMask, width * height));
+  if ((restart && !reuseImage(&incrementalEdges_, frameImage.size())) ||
+      reference == NULL ||
+      mask == NULL ||
+      !sobelAngles_.attach(width, height, workspace_.ints(Workspace::IncrementalAngles, width * height)) ||
+      !incrementalVotes_.attach(width - 1, height - 1, nScalings,
+                                workspace_.ints(Workspace::IncrementalVotes, (width - 1) * (height - 1) * nScalings))) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the incremental buffers in DetectorContext::updateEdges.");
+    img_ = frameImage;
+    incrementalValid_ = false;
+    timer_.invalidate();
+    return false;
+  }
+  if (restart) {
+    incrementalVotes_.zero();
+  } else {
+    memset(mask, 0, width * height);
+  }
+
+  // Edges depend on the pixels up to two away, and thinning looks a bit further
+  int halo(4);
+  QRect frameRect(0, 0, width, height);
+  QList<QRect> regions;
+  QRect dirty;
+  int tiles(0);
+  for (int y0 = 0; y0 < height; y0 += preprocessTileSize) {
+    for (int x0 = 0; x0 < width; x0 += preprocessTileSize) {
+      tiles++;
+      int x1(qMin(x0 + preprocessTileSize, width));
+      int y1(qMin(y0 + preprocessTileSize, height));
+      if (!refreshTile(frame, reference, x0, y0, x1, y1, changeTolerance_, restart)) {
+        continue;
+      }
+      QRect region(QRect(x0, y0, x1 - x0, y1 - y0).adjusted(-halo, -halo, halo, halo).intersected(frameRect));
+      regions.append(region);
+      dirty = dirty.united(region);
+      for (int y = region.top(); y <= region.bottom(); ++y) {
+        memset(mask + y * width + region.left(), 1, region.width());
+      }
+    }
+  }
+  issueVerboseMessage(QString("%1 of %2 tiles changed").arg(regions.size()).arg(tiles));
+  issuePartialTimingMessage("Compared tiles");
+
+  // Edges only change in the dirty area, so the count is kept up to date
+  // by counting that area before and after
+  bool counting(trace_ != NULL && !restart && incrementalEdgeCount_ >= 0);
+  if (!regions.isEmpty()) {
+    const uchar* regionMask(restart ? NULL : mask);
+    if (!restart) {
+      voteWithin(dirty, regionMask, -1);
+    }
+    if (counting) {
+      incrementalEdgeCount_ -= countEdges(incrementalEdges_, dirty);
+    }
+
+    NonRedClassifier classifier(1, 1.2);
+    PreprocessJob job;
+    job.frame_ = frame;
+    job.classifier_ = colorElimination ? &classifier : NULL;
+    job.edgeThreshold_ = edgeThreshold_;
+    job.edges_ = (uint32_t*) incrementalEdges_.bits();
+    job.edgeStride_ = incrementalEdges_.bytesPerLine() / 4;
+    job.angles_ = sobelAngles_.data();
+    // Regions overlap, but redoing a pixel gives the same edge again
+    foreach (QRect region, regions) {
+      for (int y = region.top(); y <= region.bottom(); y += preprocessTileSize) {
+        for (int x = region.left(); x <= region.right(); x += preprocessTileSize) {
+          preprocessTile(job, x, y,
+                         qMin(x + preprocessTileSize, region.right() + 1),
+                         qMin(y + preprocessTileSize, region.bottom() + 1));
+        }
+      }
+    }
+    issuePartialTimingMessage("Found edges");
+
+    thinEdges(&incrementalEdges_, dirty, regionMask);
+    if (counting) {
+      incrementalEdgeCount_ += countEdges(incrementalEdges_, dirty);
+    }
+    issuePartialTimingMessage("Thinned edges");
+
+    voteWithin(dirty, regionMask, 1);
+    issuePartialTimingMessage("Voted");
+  }
+
+  incrementalValid_ = true;
+  incrementalColors_ = colorElimination;
+  incrementalModel_ = model_.data();
+  img_ = incrementalEdges_;
+  if (trace_ == NULL) {
+    incrementalEdgeCount_ = -1;
+  } else if (!counting) {
+    incrementalEdgeCount_ = countEdges(incrementalEdges_, incrementalEdges_.rect());
+  }
+  edgeCount_ = qMax(incrementalEdgeCount_, 0);
+  issueTimingMessage("Incremental preprocessing");
+  return true;
+}
+
+/*
+ * Adds weight to the NoSpeed votes of each edge pixel in area, or only of
+ * those flagged in mask if one is given. The pixels voting and the centers
+ * voted for are the same as findNoSpeedObject() uses without any filters.
+ * */
+void DetectorContext::voteWithin(QRect area, const uchar* mask, int weight)
+{
+  RTable rTable(model_->rTable(NoSpeed));
+  int width(incrementalEdges_.width());
+  int height(incrementalEdges_.height());
+  int nScalings(numberScalings_);
+  double scalingMin(signMinSize_/model_->trainingSize(NoSpeed).width());
+  double scalingMax(signMaxSize_/model_->trainingSize(NoSpeed).width());
+  double scalingStep((scalingMax - scalingMin)/(nScalings - 1));
+
+  // The detection area is the image without its last row and column
+  int xmax(width - 1);
+  int ymax(height - 1);
+
+  int ybegin(qMax(area.top(), 1));
+  int yend(qMin(area.bottom() + 1, ymax - 1));
+  int xbegin(qMax(area.left(), 1));
+  int xend(qMin(area.right() + 1, xmax - 1));
+
+  int angle;
+  double xcp, ycp;
+  int xc, yc;
+  int entries;
+  const double* dx;
+  const double* dy;
+  for (int y = ybegin; y < yend; ++y) {
+    const QRgb* line = (const QRgb *)incrementalEdges_.constScanLine(y);
+    for (int x = xbegin; x < xend; ++x) {
+      if (qGray(line[x]) <= 0) {
+        // Black, not an edge
+        continue;
+      }
+      if (mask != NULL && mask[y * width + x] == 0) {
+        continue;
+      }
+      angle = qGray(sobelAngles_.get(x, y));
+      entries = rTable.count(angle);
+      dx = rTable.dx(angle);
+      dy = rTable.dy(angle);
+      votesCast_ += entries * nScalings;
+      for (int e = 0; e < entries; ++e) {
+        xcp = dx[e];
+        ycp = dy[e];
+        for (int s = 0; s < nScalings; ++s) {
+          xc = qRound(x + xcp * (scalingMin + s * scalingStep));
+          yc = qRound(y + ycp * (scalingMin + s * scalingStep));
+          if (xc >= 0 && xc < xmax && yc >= 0 && yc < ymax) {
+            incrementalVotes_.add(xc, yc, s, weight);
+          }
+        }
+      }
+    }
+  }
+}
+
+void DetectorContext::generateRTable(Speed speed)
+{
+  startTiming();
+  QMultiMap<int, QPair<double, double> > rTable;
+
+  int width(img_.width());
+  int height(img_.height());
+
+  // Assume the feature shape lies in the middle of the image
+  int xc = width/2;
+  int yc = height/2;
+
+  int pixelColor;
+  int angleOfEdge;
+  double angleToEdge;
+  double distance;
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      // Skip outermost border since we did so for the preparatory steps
+      if( y <= 0 || y >= height - 1 || x <= 0 || x >= width - 1 ) {
+        continue;
+      } else {
+        pixelColor = qGray(img_.pixel(x, y));
+        if (pixelColor <= 0) {
+          // Black, not an edge
+          continue;
+        }
+        // Not black, add an item into the R-table
+        angleOfEdge = qGray(sobelAngles_.get(x, y));
+        distance = qSqrt(qPow(x - xc, 2) + qPow(y - yc, 2));
+        angleToEdge = atan2Positive(y - yc, x - xc);
+        rTable.insert(angleOfEdge, QPair<double, double>(angleToEdge, distance));
+      }
+    }
+  }
+//  qDebug() << rTable;
+
+  if (rTableMaxBinSize_ > 0 || rTableMergeDistance_ > 0) {
+    pruneRTable(&rTable);
+  }
+
+  model_ = QSharedPointer<const Model>(new Model(model_->withClass(speed, RTable(rTable), img_.size())));
+  issueTimingMessage("R-table generation");
+}
+
+void DetectorContext::pruneRTable(QMultiMap<int, QPair<double, double> > *rTable)
+{
+  QMultiMap<int, QPair<double, double> > pruned;
+  QPair<double, double> v;
+  QPair<int, int> cell;
+
+  foreach (int angle, rTable->uniqueKeys()) {
+    QList<QPair<double, double> > entries(rTable->values(angle));
+
+    if (rTableMergeDistance_ > 0) {
+      QMap<QPair<int, int>, QPointF> sums;
+      QMap<QPair<int, int>, int> counts;
+      foreach (v, entries) {
+        QPointF displacement(v.second * cos(v.first), v.second * sin(v.first));
+        cell = QPair<int, int>(
+              qFloor(displacement.x() / rTableMergeDistance_),
+              qFloor(displacement.y() / rTableMergeDistance_));
+        sums[cell] += displacement;
+        counts[cell]++;
+      }
+      entries.clear();
+      foreach (cell, sums.keys()) {
+        QPointF mean(sums.value(cell).x() / counts.value(cell), sums.value(cell).y() / counts.value(cell));
+        entries.append(QPair<double, double>(
+                         atan2Positive(mean.y(), mean.x()),
+                         qSqrt(qPow(mean.x(), 2) + qPow(mean.y(), 2))));
+      }
+    }
+
+    if (rTableMaxBinSize_ > 0 && entries.size() > rTableMaxBinSize_) {
+      // Sorted by the angle to the edge, an even subsample covers the whole shape
+      qSort(entries);
+      QList<QPair<double, double> > subsample;
+      for (int i = 0; i < rTableMaxBinSize_; ++i) {
+        subsample.append(entries.at(i * entries.size() / rTableMaxBinSize_));
+      }
+      entries = subsample;
+    }
+
+    foreach (v, entries) {
+      pruned.insert(angle, v);
+    }
+  }
+
+  issueVerboseMessage(QString("Pruned R-table from %1 to %2 entries.").arg(rTable->size()).arg(pruned.size()));
+  *rTable = pruned;
+}
+
+int DetectorContext::rTableEntries()
+{
+  return model_->entries();
+}
+
+qint64 DetectorContext::votesCast()
+{
+  return votesCast_;
+}
+
+void DetectorContext::resetVotesCast()
+{
+  votesCast_ = 0;
+}
+
+QMap<DetectorContext::Speed, double> DetectorContext::detectSpeed(Detection detection)
+{
+  startTiming();
+
+  double lowerScalingFactor(0.8);
+  double upperScalingFactor(1.2);
+  int numberScalings(10);
+
+  int width(img_.width());
+  int height(img_.height());
+
+  int ymin(qMax(detection.box_.top(), 0));
+  int ymax(qMin(detection.box_.bottom(), height));
+  int xmin(qMax(detection.box_.left(), 0));
+  int xmax(qMin(detection.box_.right(), width));
+
+  issueVerboseMessage(QString("Looking at (%1,%2) -> (%3,%4) for speed.").arg(xmin).arg(ymin).arg(xmax).arg(ymax));
+
+  QMap<DetectorContext::Speed, double> maxMap;
+  Speed maxSpeed(NoSpeed);
+  double maxConfidence(0);
+
+  QRect enlargedBox(
+        detection.box_.left() - (upperScalingFactor - 1) * detection.box_.width(),
+        detection.box_.top() - (upperScalingFactor - 1) * detection.box_.height(),
+        upperScalingFactor * detection.box_.width(),
+        upperScalingFactor * detection.box_.height());
+
+  QList<Speed> speedOrder(model_->speeds());
+  if (deadline_ >= 0 && speedOrder.removeOne(lastSpeed_)) {
+    // When racing a deadline, the previously found speed is the most likely one
+    speedOrder.prepend(lastSpeed_);
+  }
+
+  RTable rTable;
+  foreach (Speed speed, speedOrder) {
+    if (speed == NoSpeed) {
+      // Do not detect empty signs.
+      continue;
+    }
+    if (deadlineReached()) {
+      issueVerboseMessage("Deadline reached, skipping remaining speeds.");
+      break;
+    }
+    rTable = model_->rTable(speed);
+
+    double detectedScaling((double)detection.box_.width()/model_->trainingSize(speed).width());
+
+    issueVerboseMessage(QString("Looking for speed %1.").arg(speeds_.value(speed)));
+
+    QList<Detection> maxList = findObject(
+          1,
+          lowerScalingFactor * detectedScaling,
+          upperScalingFactor * detectedScaling,
+          numberScalings,
+          rTable,
+          enlargedBox);
+
+    if (searchInterrupted_) {
+      // Votes for this speed are incomplete, and not comparable with the others
+      break;
+    }
+
+    double confidence((double)maxList.first().confidence_/rTable.size());
+    issuePartialTimingMessage("Isolated max");
+
+    issueMessage(QString("Found %1 with value %2 and confidence %3 at (%4,%5)").arg(
+                   speeds_.value(speed)).arg(
+                   maxList.first().confidence_).arg(
+                   confidence).arg(
+                   maxList.first().box_.center().x()).arg(
+                   maxList.first().box_.center().y()));
+    maxMap.insert(speed, confidence);
+    if (confidence > maxConfidence) {
+      maxConfidence = confidence;
+      maxSpeed = speed;
+    }
+    issueItemFound(detection.box_, confidence, 1);
+  }
+
+  issueSpeedScores(detection.box_, maxMap);
+  issueSpeedFound(detection.box_, maxConfidence, maxSpeed);
+
+  issueTimingMessage("Speed detection");
+  return maxMap;
+}
+
+QList<Detection> DetectorContext::findNoSpeedObject(int numberObjects)
+{
+  startTiming();
+
+  double scalingMin(signMinSize_/model_->trainingSize(NoSpeed).width());
+  double scalingMax(signMaxSize_/model_->trainingSize(NoSpeed).width());
+
+  Array2D* voteMask(NULL);
+  if ((minEdgeDensity_ > 0 || minRedDensity_ > 0) && buildDensityMask()) {
+    voteMask = &voteMask_;
+    startTiming();
+  }
+
+  QRect detectionArea(img_.rect());
+  if (proposalsValid_) {
+    if (proposals_.isEmpty()) {
+      issueMessage("No red regions of sign size, no sign found.");
+      issueTimingMessage("Sign detection");
+      QList<Detection> emptyList;
+      for (int i = 0; i < numberObjects; ++i) {
+        emptyList.append(Detection());
+      }
+      return emptyList;
+    }
+    if (buildProposalMask(voteMask != NULL)) {
+      voteMask = &voteMask_;
+      detectionArea = QRect();
+      foreach (QRect proposal, proposals_) {
+        detectionArea = detectionArea.united(proposal);
+      }
+    }
+  }
+
+  QList<Detection> maxList = findObject(numberObjects, scalingMin, scalingMax, numberScalings_, model_->rTable(NoSpeed), detectionArea, voteMask);
+
+  issueTimingMessage("Sign detection");
+  return maxList;
+}
+
+QList<Detection> DetectorContext::findObject(
+      int numberObjects,
+      double scalingMin,
+      double scalingMax,
+      int nScalings,
+      const RTable& rTable,
+      QRect detectionArea,
+      Array2D* voteMask
+    )
+{
+
+  int width(img_.width());
+  int height(img_.height());
+
+  int ymin(qMax(detectionArea.top(), 0));
+  int ymax(qMin(detectionArea.bottom(), height));
+  int xmin(qMax(detectionArea.left(), 0));
+  int xmax(qMin(detectionArea.right(), width));
+
+  double scalingStep((scalingMax - scalingMin)/(nScalings - 1));
+
+  // Maxima are only looked for inside the detection area, votes outside it are not kept
+  int areaWidth(qMax(xmax - xmin, 0));
+  int areaHeight(qMax(ymax - ymin, 0));
+  if (!accumulator_.attach(areaWidth, areaHeight, nScalings,
+                           workspace_.ints(Workspace::Accumulator, areaWidth * areaHeight * nScalings))) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the accumulator in DetectorContext::findObject.");
+    return QList<Detection>();
+  }
+  accumulator_.zero();
+  int pixelColor;
+  int angle;
+
+  double xcp, ycp;
+  int xc, yc;
+  int entries;
+  const double* dx;
+  const double* dy;
+
+  issuePartialTimingMessage("Allocated datastructures");
+
+  searchInterrupted_ = false;
+  for (int y = ymin; y < ymax; ++y) {
+    if (deadlineReached()) {
+      // Keep the votes cast so far, the maxima among them are the best guess we have
+      searchInterrupted_ = true;
+      issueVerboseMessage(QString("Deadline reached, voting stopped at row %1.").arg(y));
+      break;
+    }
+    const QRgb* line = (const QRgb *)img_.constScanLine(y);
+    for (int x = xmin; x < xmax; ++x) {
+      if( y <= ymin || y >= ymax - 1 || x <= xmin || x >= xmax - 1 ) {
+        continue;
+      } else {
+        pixelColor = qGray(line[x]);
+        if (pixelColor <= 0) {
+          // Black, not an edge
+          continue;
+        }
+        if (voteMask != NULL && voteMask->get(x, y) <= 0) {
+          // Not inside any window that could hold a sign
+          continue;
+        }
+        // Not black, check the R-table
+        angle = qGray(sobelAngles_.get(x, y));
+        entries = rTable.count(angle);
+        dx = rTable.dx(angle);
+        dy = rTable.dy(angle);
+        votesCast_ += entries * nScalings;
+        for (int e = 0; e < entries; ++e) {
+          xcp = dx[e];
+          ycp = dy[e];
+          for (int s = 0; s < nScalings; ++s) {
+            xc = qRound(x + xcp * (scalingMin + s * scalingStep));
+            yc = qRound(y + ycp * (scalingMin + s * scalingStep));
+            if (xc >= xmin && xc < xmax && xc < width - 1 && yc >= ymin && yc < ymax && yc < height - 1) {
+              accumulator_.increment(xc - xmin, yc - ymin, s);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  issuePartialTimingMessage("Voted");
+
+  return isolateMaxima(numberObjects, &accumulator_, xmin, ymin, xmax, ymax, scalingMin, scalingStep, nScalings);
+}
+
+/*
+ * Picks the numberObjects highest votes for centers in [xmin, xmax) x
+ * [ymin, ymax), at the scaling of the layer they are in, and reports them.
+ * */
+QList<Detection> DetectorContext::isolateMaxima(
+      int numberObjects,
+      Array3D* votes,
+      int xmin,
+      int ymin,
+      int xmax,
+      int ymax,
+      double scalingMin,
+      double scalingStep,
+      int nScalings
+    )
+{
+  QList<Detection> maxList;
+  for (int i = 0; i < numberObjects; ++i) {
+    maxList.append(Detection());
+  }
+  int val;
+  QSize trainingSize(model_->trainingSize(NoSpeed));
+  Detection smallest;
+  int foundWidth, foundHeight;
+  QRect foundRect;
+//  QStringList dump;
+  for (int y = ymin; y < ymax; ++y) {
+    for (int x = xmin; x < xmax; ++x) {
+      for (int s = 0; s < nScalings; ++s) {
+        val = votes->get(x - xmin, y - ymin, s);
+        if (val > smallest.confidence_) {
+          maxList.removeOne(smallest);
+          foundWidth = (scalingMin + s * scalingStep) * trainingSize.width();
+          foundHeight = (scalingMin + s * scalingStep) * trainingSize.height();
+          foundRect = QRect(
+              x - foundWidth / 2,
+              y - foundHeight / 2,
+              foundWidth,
+              foundHeight
+            ),
+          maxList.append(Detection(foundRect, val));
+          qSort(maxList);
+          smallest = maxList.at(0);
+        }
+//      dump << QString::number(accumulator[x][y][s]);
+      }
+    }
+  }
+//  qDebug() << dump;
+//  qDebug() << maxList;
+  issuePartialTimingMessage("Isolated max");
+
+  Detection d;
+  for (int i = 0; i < numberObjects; ++i) {
+    d = maxList.at(i);
+
+    QString msg1(QString("Found object with confidence: %1").arg(d.confidence_));
+    QString msg2(QString("-- At: (%1, %2), %3x%4").arg(
+                   d.box_.center().x()).arg(
+                   d.box_.center().y()).arg(
+                   d.box_.width()).arg(
+                   d.box_.height()));
+    if (i == numberObjects - 1) {
+      issueMessage(msg1);
+      issueMessage(msg2);
+    } else {
+      issueVerboseMessage(msg1);
+      issueVerboseMessage(msg2);
+    }
+  }
+
+  return maxList;
+}
+
+void DetectorContext::eliminateColors(double greenfactor, double bluefactor)
+{
+  startTiming();
+
+  if (img_.format() != QImage::Format_RGB32 && img_.format() != QImage::Format_ARGB32) {
+    img_ = img_.convertToFormat(QImage::Format_RGB32);
+  }
+
+  int width(img_.width());
+  int height(img_.height());
+
+  // Remember the remaining red pixels for the density filter
+  redPixelsValid_ = minRedDensity_ > 0 &&
+      redPixels_.attach(width, height, workspace_.ints(Workspace::RedPixels, width * height));
+
+  if (!eliminateColorsInPlace(
+        (uint32_t*) writableBits(),
+        width,
+        height,
+        img_.bytesPerLine() / 4,
+        greenfactor,
+        bluefactor,
+        redPixelsValid_ ? redPixels_.data() : NULL,
+        &workspace_)) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the color elimination in DetectorContext::eliminateColors.");
+    redPixelsValid_ = false;
+    timer_.invalidate();
+    return;
+  }
+
+  issueTimingMessage("Color elimination");
+}
+
+int DetectorContext::windowSum(Array2D* integral, int x, int y, int size)
+{
+  return integral->get(x + size, y + size) - integral->get(x, y + size) - integral->get(x + size, y) + integral->get(x, y);
+}
+
+/*
+ * Fills voteMask_ with the pixels covered by at least one window, of the
+ * smallest, middle or largest sign size, that passes the density filter.
+ * */
+bool DetectorContext::buildDensityMask()
+{
+  startTiming();
+
+  int width(img_.width());
+  int height(img_.height());
+
+  bool useEdges(minEdgeDensity_ > 0);
+  bool useRed(minRedDensity_ > 0 && redPixelsValid_ && redPixels_.xSize() == width && redPixels_.ySize() == height);
+  if (!useEdges && !useRed) {
+    timer_.invalidate();
+    return false;
+  }
+
+  int size((width + 1) * (height + 1));
+  if (!edgeIntegral_.attach(width + 1, height + 1, workspace_.ints(Workspace::EdgeIntegral, size)) ||
+      !redIntegral_.attach(width + 1, height + 1, workspace_.ints(Workspace::RedIntegral, size)) ||
+      !voteMask_.attach(width + 1, height + 1, workspace_.ints(Workspace::VoteMask, size))) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the density filter in DetectorContext::buildDensityMask.");
+    timer_.invalidate();
+    return false;
+  }
+  edgeIntegral_.zero();
+  redIntegral_.zero();
+  voteMask_.zero();
+
+  // Entry (x, y) of an integral image holds the sum over all pixels above and to the left of (x, y)
+  int edge;
+  int red;
+  for (int y = 0; y < height; ++y) {
+    const QRgb* line = (const QRgb *)img_.constScanLine(y);
+    for (int x = 0; x < width; ++x) {
+      edge = qGray(line[x]) > 0 ? 1 : 0;
+      edgeIntegral_.set(x + 1, y + 1, edge + edgeIntegral_.get(x, y + 1) + edgeIntegral_.get(x + 1, y) - edgeIntegral_.get(x, y));
+      if (useRed) {
+        red = redPixels_.get(x, y);
+        redIntegral_.set(x + 1, y + 1, red + redIntegral_.get(x, y + 1) + redIntegral_.get(x + 1, y) - redIntegral_.get(x, y));
+      }
+    }
+  }
+  issuePartialTimingMessage("Integral images");
+
+  QList<int> windowSizes;
+  windowSizes << qRound(signMinSize_) << qRound((signMinSize_ + signMaxSize_) / 2) << qRound(signMaxSize_);
+
+  // Mark the corners of each surviving window, the prefix sum below then covers the window
+  int windows(0);
+  foreach (int size, windowSizes) {
+    double minEdges(minEdgeDensity_ * M_PI * size);
+    double minRed(minRedDensity_ * size * size);
+    for (int y = 0; y + size <= height; ++y) {
+      for (int x = 0; x + size <= width; ++x) {
+        if (useEdges && windowSum(&edgeIntegral_, x, y, size) < minEdges) {
+          continue;
+        }
+        if (useRed && windowSum(&redIntegral_, x, y, size) < minRed) {
+          continue;
+        }
+        voteMask_.increment(x, y);
+        voteMask_.set(x + size, y, voteMask_.get(x + size, y) - 1);
+        voteMask_.set(x, y + size, voteMask_.get(x, y + size) - 1);
+        voteMask_.increment(x + size, y + size);
+        windows++;
+      }
+    }
+  }
+
+  int edges(0);
+  int keptEdges(0);
+  for (int y = 0; y <= height; ++y) {
+    for (int x = 0; x <= width; ++x) {
+      if (x > 0) {
+        voteMask_.set(x, y, voteMask_.get(x, y) + voteMask_.get(x - 1, y));
+      }
+      if (y > 0) {
+        voteMask_.set(x, y, voteMask_.get(x, y) + voteMask_.get(x, y - 1));
+      }
+      if (x > 0 && y > 0) {
+        voteMask_.set(x, y, voteMask_.get(x, y) - voteMask_.get(x - 1, y - 1));
+      }
+      if (x < width && y < height && windowSum(&edgeIntegral_, x, y, 1) > 0) {
+        edges++;
+        if (voteMask_.get(x, y) > 0) {
+          keptEdges++;
+        }
+      }
+    }
+  }
+
+  issueVerboseMessage(QString("Density filter kept %1 windows and %2 of %3 edge pixels.").arg(windows).arg(keptEdges).arg(edges));
+  issueTimingMessage("Density filter");
+  return true;
+}
+
+/*
+ * Labels the connected components of red dominant pixels, and returns the
+ * surroundings of those whose size could be a sign. The result is also kept
+ * for findNoSpeedObject() until the next image is loaded.
+ *
+ * The components are found from runs of red pixels in each row, where runs
+ * touching a run in the row above are joined using union-find.
+ * */
+QList<QRect> DetectorContext::proposeRedRegions(double greenfactor, double bluefactor)
+{
+  startTiming();
+
+  int width(img_.width());
+  int height(img_.height());
+
+  FrameView frame(frameView());
+  uint32_t* converted = (uint32_t*) workspace_.buffer(Workspace::RowPixels, sizeof(uint32_t) * width);
+  if (converted == NULL) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for a row of pixels in DetectorContext::proposeRedRegions.");
+    timer_.invalidate();
+    return proposals_;
+  }
+
+  QVector<int> runStart;
+  QVector<int> runEnd;
+  QVector<int> runRow;
+  QVector<int> parent;
+
+  int previousFirst(0);
+  int previousLast(0);
+  QRgb color;
+  int red;
+  for (int y = 0; y < height; ++y) {
+    const QRgb* line = frame.row(y, 0, width, converted);
+    int first(runStart.size());
+    int above(previousFirst);
+    int x(0);
+    while (x < width) {
+      color = line[x];
+      red = qRed(color);
+      if (red <= qGreen(color) * greenfactor || red <= qBlue(color) * bluefactor) {
+        ++x;
+        continue;
+      }
+      int start(x);
+      while (x < width) {
+        color = line[x];
+        red = qRed(color);
+        if (red <= qGreen(color) * greenfactor || red <= qBlue(color) * bluefactor) {
+          break;
+        }
+        ++x;
+      }
+      int run(runStart.size());
+      runStart.append(start);
+      runEnd.append(x - 1);
+      runRow.append(y);
+      parent.append(run);
+
+      // Join with the runs above that touch this one, including diagonally
+      while (above < previousLast && runEnd.at(above) < start - 1) {
+        ++above;
+      }
+      for (int a = above; a < previousLast && runStart.at(a) <= x; ++a) {
+        int rootA(findRoot(&parent, a));
+        int rootRun(findRoot(&parent, run));
+        if (rootA != rootRun) {
+          parent[qMax(rootA, rootRun)] = qMin(rootA, rootRun);
+        }
+      }
+    }
+    previousFirst = first;
+    previousLast = runStart.size();
+  }
+
+  QMap<int, QRect> components;
+  for (int run = 0; run < runStart.size(); ++run) {
+    int root(findRoot(&parent, run));
+    QRect runRect(QPoint(runStart.at(run), runRow.at(run)), QPoint(runEnd.at(run), runRow.at(run)));
+    components.insert(root, components.value(root).united(runRect));
+  }
+
+  // The ring of a sign may be partly washed out, allow some slack on the size
+  double minSize(0.8 * signMinSize_);
+  double maxSize(1.2 * signMaxSize_);
+  proposals_.clear();
+  foreach (QRect component, components.values()) {
+    int size(qMax(component.width(), component.height()));
+    if (size < minSize || size > maxSize) {
+      continue;
+    }
+    int margin(qRound(0.25 * size));
+    proposals_.append(component.adjusted(-margin, -margin, margin, margin).intersected(img_.rect()));
+  }
+  proposalsValid_ = true;
+
+  issueVerboseMessage(QString("Proposed %1 of %2 red regions.").arg(proposals_.size()).arg(components.size()));
+  issueTimingMessage("Red region proposals");
+  return proposals_;
+}
+
+int DetectorContext::findRoot(QVector<int>* parent, int run)
+{
+  while ((*parent)[run] != run) {
+    // Path halving keeps the trees flat
+    (*parent)[run] = (*parent)[(*parent)[run]];
+    run = (*parent)[run];
+  }
+  return run;
+}
+
+/*
+ * Restricts voteMask_ to the red region proposals. With combine set, the
+ * density mask already in voteMask_ is kept inside the proposals.
+ * */
+bool DetectorContext::buildProposalMask(bool combine)
+{
+  int width(img_.width());
+  int height(img_.height());
+
+  Array2D inside;
+  if (!inside.attach(width + 1, height, workspace_.ints(Workspace::ProposalMask, (width + 1) * height)) ||
+      (!combine && !voteMask_.attach(width + 1, height + 1, workspace_.ints(Workspace::VoteMask, (width + 1) * (height + 1))))) {
+    // Failed to allocate memory, abort nicely
+    issueMessage("Failed to allocate memory for the proposal mask in DetectorContext::buildProposalMask.");
+    return false;
+  }
+  inside.zero();
+  if (!combine) {
+    voteMask_.zero();
+  }
+
+  // Mark where each proposal starts and ends on its rows, a running sum along the row then tells if inside
+  foreach (QRect proposal, proposals_) {
+    for (int y = proposal.top(); y <= proposal.bottom(); ++y) {
+      inside.increment(proposal.left(), y);
+      inside.set(proposal.right() + 1, y, inside.get(proposal.right() + 1, y) - 1);
+    }
+  }
+
+  int covered;
+  for (int y = 0; y < height; ++y) {
+    covered = 0;
+    for (int x = 0; x < width; ++x) {
+      covered += inside.get(x, y);
+      if (covered <= 0) {
+        voteMask_.set(x, y, 0);
+      } else if (!combine) {
+        voteMask_.set(x, y, 1);
+      }
+    }
+  }
+  return true;
+}
+
+QRgb DetectorContext::getColor(QPoint point)
+{
+  if (img_.valid(point)) {
+    return img_.pixel(point);
+  }
+  return qRgb(0, 0, 0);
+}
+
+
+void DetectorContext::checkNeighborPixel(bool isEdge, bool* currentlyEdge, int* n, int* s)
+{
+  if (isEdge) {
+    (*n)++;
+    if (!(*currentlyEdge)) {
+      (*s)++;
+      (*currentlyEdge) = true;
+    }
+  } else if ((*currentlyEdge)) {
+    (*s)++;
+    (*currentlyEdge) = false;
+  }
+}
+
+void DetectorContext::edgeThinning()
+{
+  startTiming();
+  thinEdges(&img_, img_.rect(), NULL);
+  if (trace_ != NULL) {
+    edgeCount_ = countEdges(img_, img_.rect());
+  }
+  issueTimingMessage("Edge thinning");
+}
+
+/*
+ * Thins the edges in area, only removing pixels flagged in mask, if one is
+ * given. Pixels outside are looked at as neighbors, but are left as they are.
+ * Sets searchInterrupted_ when the deadline stopped it before it was done.
+ * */
+void DetectorContext::thinEdges(QImage* edges, QRect area, const uchar* mask)
+{
+  int width(edges->width());
+  int height(edges->height());
+
+  int n;
+  int s;
+  bool currentlyEdge;
+  int pixelColor;
+  bool neighbors[8];
+  bool changed = true;
+
+  QList<QPoint> toKill;
+  while (changed && !deadlineReached()) {
+    changed = false;
+    for (int direction = 0; direction < 7; direction+=2) {
+      for (int y = area.top(); y <= area.bottom(); ++y) {
+        for (int x = area.left(); x <= area.right(); ++x) {
+          // Ignore outermost border, so we can have an easier/faster checking below
+          if( y <= 0 || y >= height - 1 || x <= 0 || x >= width - 1 ) {
+            continue;
+          }
+          if (mask != NULL && mask[y * width + x] == 0) {
+            continue;
+          }
+          pixelColor = qGray(edges->pixel(x, y));
+          if (pixelColor <= 0) {
+            // Already black, needs no thinning
+            continue;
+          }
+
+          n = 0;
+          s = 0;
+
+          /*
+           * This is the indexing of the neighbors
+           *  -------------
+           *  | 7 | 0 | 1 |
+           *  -------------
+           *  | 6 | X | 2 |
+           *  -------------
+           *  | 5 | 4 | 3 |
+           *  -------------
+           *
+          */
+
+          neighbors[0] = qGray(edges->pixel(x, y - 1)) > 0;
+          neighbors[1] = qGray(edges->pixel(x + 1, y - 1)) > 0;
+          neighbors[2] = qGray(edges->pixel(x + 1, y)) > 0;
+          neighbors[3] = qGray(edges->pixel(x + 1, y + 1)) > 0;
+          neighbors[4] = qGray(edges->pixel(x, y + 1)) > 0;
+          neighbors[5] = qGray(edges->pixel(x - 1, y + 1)) > 0;
+          neighbors[6] = qGray(edges->pixel(x - 1, y)) > 0;
+          neighbors[7] = qGray(edges->pixel(x - 1, y - 1)) > 0;
+
+          if (neighbors[direction] > 0) {
+            // Not removing pixels in the current direction
+            continue;
+          }
+
+          currentlyEdge = false;
+          if (neighbors[0] > 0) {
+            n++;
+            currentlyEdge = true;
+          }
+          checkNeighborPixel(neighbors[1], &currentlyEdge, &n, &s);
+          checkNeighborPixel(neighbors[2], &currentlyEdge, &n, &s);
+          checkNeighborPixel(neighbors[3], &currentlyEdge, &n, &s);
+          checkNeighborPixel(neighbors[4], &currentlyEdge, &n, &s);
+          checkNeighborPixel(neighbors[5], &currentlyEdge, &n, &s);
+          checkNeighborPixel(neighbors[6], &currentlyEdge, &n, &s);
+          checkNeighborPixel(neighbors[7], &currentlyEdge, &n, &s);
+
+          if (
+              n == 0 || // Standalone pixel is removed
+              (n > 1 && // End of a line is kept
+              n <= 6 && // Interior points are kept
+              s < 3) // Bridge pixels are kept
+          ) {
+            // Kill pixel
+            toKill.append(QPoint(x, y));
+            changed = true;
+          }
+        }
+      }
+      foreach (QPoint p, toKill) {
+        edges->setPixel(p.x(), p.y(), qRgb(0, 0, 0));
+      }
+    }
+  }
+  // Still changing, so the deadline stopped it
+  searchInterrupted_ = changed;
+}
+
+void DetectorContext::issueMessage(QString message)
+{
+  if (listener_ != NULL) {
+    listener_->onMessage(message);
+  }
+}
+
+void DetectorContext::issueVerboseMessage(QString message)
+{
+  if (listener_ != NULL) {
+    listener_->onVerboseMessage(message);
+  }
+}
+
+void DetectorContext::issueTiming(QString message)
+{
+  if (listener_ != NULL) {
+    listener_->onTiming(message);
+  }
+}
+
+void DetectorContext::issueItemFound(QRect position, int confidence, int order)
+{
+  if (listener_ != NULL) {
+    listener_->onItemFound(position.translated(origin_), confidence, order);
+  }
+}
+
+void DetectorContext::issueSpeedFound(QRect position, double confidence, Speed speed)
+{
+  if (listener_ != NULL) {
+    listener_->onSpeedFound(position.translated(origin_), confidence, speed);
+  }
+}
+
+void DetectorContext::issueSpeedScores(QRect position, QMap<Speed, double> scores)
+{
+  if (listener_ != NULL) {
+    listener_->onSpeedScores(position.translated(origin_), scores);
+  }
+}
+
+int DetectorContext::interpolate(int a, int b, int progress)
+{
+  return a + (a - b) * ((float) progress / 45);
+}
+
+/*
+ * Starts timing a step, which ends with issueTimingMessage(). The parts of
+ * the step are timed from one issuePartialTimingMessage() to the next, and
+ * handed to the listener as "<step>/<part>" when the step ends, as the same
+ * part, like "Voted", comes in several steps.
+ * */
+void DetectorContext::startTiming()
+{
+  timer_.start();
+  partialMark_ = 0;
+  partialTimes_.clear();
+}
+
+void DetectorContext::issueTimingMessage(QString message)
+{
+  issueTiming(QString("%1: %2 ms").arg(message).arg(QString::number(timer_.elapsed())));
+  if (listener_ != NULL && timer_.isValid()) {
+    listener_->onStepTiming(message, timer_.nsecsElapsed() / 1000000.0);
+    for (int i = 0; i < partialTimes_.size(); ++i) {
+      listener_->onStepTiming(message + "/" + partialTimes_.at(i).first, partialTimes_.at(i).second);
+    }
+  }
+  partialTimes_.clear();
+  if (trace_ != NULL && timer_.isValid()) {
+    double duration(timer_.nsecsElapsed() / 1000.0);
+    trace_->complete(message, trace_->now() - duration, duration);
+  }
+  timer_.invalidate();
+}
+
+void DetectorContext::issuePartialTimingMessage(QString message)
+{
+  qint64 elapsed(timer_.nsecsElapsed());
+  issueTiming(QString("-- %1: %2 ms").arg(message).arg(QString::number(elapsed / 1000000)));
+  if (listener_ != NULL && timer_.isValid()) {
+    partialTimes_.append(qMakePair(message, (elapsed - partialMark_) / 1000000.0));
+  }
+  if (trace_ != NULL && timer_.isValid()) {
+    double duration((elapsed - partialMark_) / 1000.0);
+    trace_->complete(message, trace_->now() - duration, duration);
+  }
+  partialMark_ = elapsed;
+}
+
+/*
+ * Reports how many frame sized buffers were allocated since the last report,
+ * which drops to 0 once the workspace fits the frames of a stream.
+ * */
+void DetectorContext::issueAllocationMessage()
+{
+  issueTiming(QString("Buffer allocations: %1").arg(workspace_.takeAllocations()));
+}
+
+bool DetectorContext::deadlineReached()
+{
+  return deadline_ >= 0 && deadlineTimer_.hasExpired(deadline_);
+}
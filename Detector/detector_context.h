@@ -0,0 +1,232 @@
+#ifndef DETECTOR_CONTEXT_H
+#define DETECTOR_CONTEXT_H
+
+// Qt Includes
+#include <QString>
+#include <QImage>
+#include <QMultiMap>
+#include <QPair>
+#include <QSharedPointer>
+#include <QVector>
+#include <QElapsedTimer>
+
+// Detector Includes
+#include "arrays.h"
+#include "detection.h"
+#include "detector_listener.h"
+#include "frame_view.h"
+#include "model.h"
+#include "sign_track.h"
+#include "speed_classes.h"
+#include "workspace.h"
+
+// Forward declarations
+class DetectionResult;
+class TraceRecorder;
+
+/*
+ * Everything needed to detect signs in one image at a time: the settings, the
+ * image and the buffers of all stages. The trained model is shared, and is
+ * only read, so contexts on different threads can use the same model without
+ * locking. A context itself is used by one thread at a time.
+ * */
+class DetectorContext : public SpeedClasses
+{
+public:
+  DetectorContext();
+  DetectorContext(QString file);
+
+  void initialize();
+  void setListener(DetectorListener* listener);
+
+  void setModel(QSharedPointer<const Model> model);
+  QSharedPointer<const Model> model() const;
+  bool loadModel(QString file);
+  bool saveModel(QString file);
+  QByteArray trainingSetHash(QString trainingFolder);
+
+  void setEdgeThreshold(double threshold);
+  void setHarrisThreshold(double threshold);
+  void setRTablePruning(int maxBinSize, double mergeDistance);
+  void setDensityFilter(double minEdgeDensity, double minRedDensity);
+  void setRedProposals(bool redProposals);
+  void setPreprocessThreads(int threads);
+  void setBlurSigma(double sigma);
+  void setTrainingThreads(int threads);
+  void setTracking(int fullSearchInterval);
+  void setChangeTolerance(int tolerance);
+  void setTiledDetection(int tileSize, int signs = 1);
+  int minimumTileSize();
+  void setTraceRecorder(TraceRecorder* trace);
+  void copySettings(const DetectorContext& other);
+
+  void loadImage();
+  void loadImage(QString file);
+  void setImage(QImage image);
+  void loadFrame(const uchar* data, int width, int height, int stride, FrameView::Format format);
+  void releaseFrame();
+
+  QImage image();
+  QImage sobelAngleImage();
+
+  QRect getImageSize();
+  QSize sourceSize();
+  int edgeCount();
+
+  void blurred(double sigma = 1.1);
+  void preprocess(bool colorElimination);
+  void sobelEdges();
+  void edgeThinning();
+  void harrisCorners();
+
+  void train(QString trainingFolder);
+  void trainHarris(QString trainingFolder);
+  void trainClass(Speed speed, QString trainingFolder);
+  void detect(bool colorElimination);
+  void detectHarris(bool colorElimination);
+  DetectionResult detectWithin(bool colorElimination, qint64 budget);
+  void detectTracked(bool colorElimination);
+  QList<SignTrack> tracks() const;
+  void resetTracks();
+  void detectIncremental(bool colorElimination);
+  void resetIncremental();
+  void detectTiled(bool colorElimination);
+
+  void generateRTable(Speed speed);
+  int rTableEntries();
+  qint64 votesCast();
+  void resetVotesCast();
+
+  QList<Detection> findNoSpeedObject(int numberObjects = 10);
+  QMap<Speed, double> detectSpeed(Detection detection);
+
+  void eliminateColors(double greenfactor, double bluefactor);
+  QList<QRect> proposeRedRegions(double greenfactor, double bluefactor);
+
+  QRgb getColor(QPoint point);
+
+private:
+  friend class TrainingQueue;
+
+  DetectorContext(const DetectorContext&);
+  DetectorContext& operator=(const DetectorContext&);
+
+  void issueMessage(QString message);
+  void issueVerboseMessage(QString message);
+  void issueTiming(QString message);
+  void issueItemFound(QRect position, int confidence, int order);
+  void issueSpeedFound(QRect position, double confidence, Speed speed);
+  void issueSpeedScores(QRect position, QMap<Speed, double> scores);
+
+  int interpolate(int a, int b, int progress);
+  void startTiming();
+  void issueTimingMessage(QString message);
+  void issuePartialTimingMessage(QString message);
+  void issueAllocationMessage();
+  bool deadlineReached();
+  void fitImage();
+  FrameView frameView();
+  void replaceImage(QImage image);
+  void useTile(const QImage& frameImage, QRect tile);
+  bool reuseImage(QImage* image, QSize size);
+  uchar* writableBits();
+
+  TrainingInfo trainingInfo(TrainingInfo::Mode mode, QString trainingFolder);
+  void trainAll(TrainingInfo::Mode mode, QString trainingFolder);
+  void trainClassImage(Speed speed, QString trainingFolder);
+  void pruneRTable(QMultiMap<int, QPair<double, double> > *rTable);
+
+  void checkNeighborPixel(bool isEdge, bool *currentlyEdge, int *n, int *s);
+  void thinEdges(QImage* edges, QRect area, const uchar* mask);
+  static int countEdges(const QImage& edges, QRect area);
+  bool updateEdges(bool colorElimination);
+  void voteWithin(QRect area, const uchar* mask, int weight);
+  QList<Detection> findObject(int numberObjects, double scalingMin, double scalingMax, int nScalings, const RTable& rTable, QRect detectionArea, Array2D* voteMask = NULL);
+  QList<Detection> isolateMaxima(int numberObjects, Array3D* votes, int xmin, int ymin, int xmax, int ymax, double scalingMin, double scalingStep, int nScalings);
+  bool followTrack(SignTrack* track);
+  void classifyTrack(SignTrack* track);
+
+  int windowSum(Array2D* integral, int x, int y, int size);
+  bool buildDensityMask();
+  bool buildProposalMask(bool combine);
+  int findRoot(QVector<int>* parent, int run);
+
+public:
+  QMap<Speed, QString> speeds_;
+
+private:
+  DetectorListener* listener_;
+  QSharedPointer<const Model> model_;
+
+  QString file_;
+  QImage img_;
+  // The size of the image or frame before it was shrunk
+  QSize sourceSize_;
+  const uchar* frameData_;
+  Workspace workspace_;
+  QImage decoded_;
+  QImage fitted_;
+  QImage edges_;
+  Array3D accumulator_;
+  Array2D sobelAngles_;
+  Array2D redPixels_;
+  Array2D edgeIntegral_;
+  Array2D redIntegral_;
+  Array2D voteMask_;
+  bool redPixelsValid_;
+  QList<QRect> proposals_;
+  bool proposalsValid_;
+
+  double edgeThreshold_;
+  double harrisThreshold_;
+
+  int rTableMaxBinSize_;
+  double rTableMergeDistance_;
+
+  double minEdgeDensity_;
+  double minRedDensity_;
+  bool redProposals_;
+  int preprocessThreads_;
+  int trainingThreads_;
+  double blurSigma_;
+  qint64 votesCast_;
+  // Edge pixels left by the last edge thinning of the image, only counted
+  // for the trace
+  int edgeCount_;
+
+  QSize imgSize_;
+
+  double signMaxSize_;
+  double signMinSize_;
+  double numberScalings_;
+
+  QElapsedTimer timer_;
+  qint64 partialMark_;
+  // Milliseconds of each part of the step being timed, until it ends
+  QList<QPair<QString, double> > partialTimes_;
+  TraceRecorder* trace_;
+
+  QElapsedTimer deadlineTimer_;
+  qint64 deadline_;
+  bool searchInterrupted_;
+  Speed lastSpeed_;
+
+  QList<SignTrack> tracks_;
+  int fullSearchInterval_;
+  int framesSinceFullSearch_;
+
+  QImage incrementalEdges_;
+  Array3D incrementalVotes_;
+  bool incrementalValid_;
+  bool incrementalColors_;
+  const Model* incrementalModel_;
+  // Edge pixels in incrementalEdges_, -1 when not kept up to date
+  int incrementalEdgeCount_;
+  int changeTolerance_;
+
+  int tileSize_;
+  int tileSigns_;
+  QPoint origin_;
+};
+
+#endif // DETECTOR_CONTEXT_H
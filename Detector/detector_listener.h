@@ -0,0 +1,34 @@
+#ifndef DETECTOR_LISTENER_H
+#define DETECTOR_LISTENER_H
+
+// Qt includes
+#include <QMap>
+#include <QRect>
+#include <QString>
+
+// Detector includes
+#include "speed_classes.h"
+
+/*
+ * Receives the messages and findings of a DetectorContext, on the thread
+ * running it.
+ * */
+class DetectorListener
+{
+public:
+  virtual ~DetectorListener() {}
+
+  virtual void onMessage(QString message) = 0;
+  virtual void onVerboseMessage(QString message) = 0;
+  virtual void onTiming(QString message) = 0;
+  virtual void onItemFound(QRect position, int confidence, int order) = 0;
+  virtual void onSpeedFound(QRect position, double confidence, SpeedClasses::Speed speed) = 0;
+
+  // Only of use to listeners that keep more than the messages. Step timings
+  // come for each step as it ends, followed by each part of it since the
+  // part before, named after the step, like "Sign detection/Voted".
+  virtual void onStepTiming(QString, double) {}
+  virtual void onSpeedScores(QRect, QMap<SpeedClasses::Speed, double>) {}
+};
+
+#endif // DETECTOR_LISTENER_H
@@ -0,0 +1,168 @@
+#include "downscale.h"
+
+// Fixed point weights of each target pixel sum up to 1 << areaWeightBits
+static const int areaWeightBits = 12;
+
+/*
+ * For each of the target pixels along one axis, finds the first source pixel
+ * it covers and the share of each covered source pixel in fixed point. Every
+ * target pixel covers at most span source pixels, unused weights are 0.
+ * */
+static void buildSpans(int sourceSize, int targetSize, int span, int* first, int32_t* weights)
+{
+  double scale((double) sourceSize / targetSize);
+  double start, end, overlap;
+  int32_t* w;
+  int32_t sum;
+  int heaviest;
+  for (int t = 0; t < targetSize; ++t) {
+    start = t * scale;
+    end = (t + 1) * scale;
+    // Keep all span pixels inside the source, the ones not covered get no weight
+    first[t] = (int) start;
+    if (first[t] > sourceSize - span) {
+      first[t] = sourceSize - span;
+    }
+
+    w = weights + t * span;
+    sum = 0;
+    heaviest = 0;
+    for (int k = 0; k < span; ++k) {
+      int s(first[t] + k);
+      overlap = (s + 1 < end ? s + 1 : end) - (s > start ? s : start);
+      w[k] = overlap > 0 ? (int32_t) (overlap / scale * (1 << areaWeightBits) + 0.5) : 0;
+      sum += w[k];
+      if (w[k] > w[heaviest]) {
+        heaviest = k;
+      }
+    }
+    // Rounding leftovers go to the largest share, so flat areas stay exactly as they are
+    w[heaviest] += (1 << areaWeightBits) - sum;
+  }
+}
+
+/*
+ * Shrinks the frame to the target size in 32 bit (A)RGB by averaging the
+ * source area each target pixel covers, counting partly covered source
+ * pixels by the part they share. All four channels are averaged separately.
+ *
+ * The averaging is separable, so the rows are shrunk first, into 16 bit
+ * channels with 8 extra bits of precision, and the columns after that. The
+ * target must not be larger than the source in either direction.
+ *
+ * The buffers come from the workspace if one is given. Returns false if they
+ * could not be allocated.
+ * */
+bool downscaleArea(
+    const FrameView& source,
+    uint32_t* target,
+    int targetWidth,
+    int targetHeight,
+    int targetStride,
+    Workspace* workspace)
+{
+  int sourceWidth(source.width_);
+  int sourceHeight(source.height_);
+  if (targetWidth <= 0 || targetHeight <= 0 || targetWidth > sourceWidth || targetHeight > sourceHeight) {
+    return false;
+  }
+
+  // A target pixel covers at most this many source pixels, including the partly covered ones
+  int spanX((sourceWidth + targetWidth - 1) / targetWidth + 1);
+  int spanY((sourceHeight + targetHeight - 1) / targetHeight + 1);
+  if (spanX > sourceWidth) {
+    spanX = sourceWidth;
+  }
+  if (spanY > sourceHeight) {
+    spanY = sourceHeight;
+  }
+
+  Workspace local;
+  if (workspace == 0) {
+    workspace = &local;
+  }
+
+  size_t sizes[7] = {
+    Workspace::aligned(sizeof(int) * targetWidth),
+    Workspace::aligned(sizeof(int) * targetHeight),
+    Workspace::aligned(sizeof(int32_t) * targetWidth * spanX),
+    Workspace::aligned(sizeof(int32_t) * targetHeight * spanY),
+    Workspace::aligned(sizeof(uint16_t) * 4 * targetWidth * sourceHeight),
+    Workspace::aligned(sizeof(int32_t) * 4 * targetWidth),
+    Workspace::aligned(sizeof(uint32_t) * sourceWidth)
+  };
+  size_t total(0);
+  for (int i = 0; i < 7; ++i) {
+    total += sizes[i];
+  }
+  char* scratch = (char*) workspace->buffer(Workspace::Downscale, total);
+  if (scratch == NULL) {
+    return false;
+  }
+  int* firstX = (int*) scratch;
+  int* firstY = (int*) (scratch += sizes[0]);
+  int32_t* weightsX = (int32_t*) (scratch += sizes[1]);
+  int32_t* weightsY = (int32_t*) (scratch += sizes[2]);
+  uint16_t* rows = (uint16_t*) (scratch += sizes[3]);
+  int32_t* sums = (int32_t*) (scratch += sizes[4]);
+  uint32_t* converted = (uint32_t*) (scratch += sizes[5]);
+
+  buildSpans(sourceWidth, targetWidth, spanX, firstX, weightsX);
+  buildSpans(sourceHeight, targetHeight, spanY, firstY, weightsY);
+
+  const int rowShift(areaWeightBits - 8);
+  const int columnShift(areaWeightBits + 8);
+
+  const uint32_t* line;
+  uint16_t* out;
+  uint32_t color;
+  int32_t weight;
+  int32_t a, r, g, b;
+  for (int y = 0; y < sourceHeight; ++y) {
+    line = source.row(y, 0, sourceWidth, converted);
+    out = rows + y * 4 * targetWidth;
+    for (int x = 0; x < targetWidth; ++x) {
+      a = r = g = b = 0;
+      for (int k = 0; k < spanX; ++k) {
+        color = line[firstX[x] + k];
+        weight = weightsX[x * spanX + k];
+        a += (int32_t) (color >> 24) * weight;
+        r += (int32_t) ((color >> 16) & 0xff) * weight;
+        g += (int32_t) ((color >> 8) & 0xff) * weight;
+        b += (int32_t) (color & 0xff) * weight;
+      }
+      out[4 * x] = (uint16_t) ((a + (1 << (rowShift - 1))) >> rowShift);
+      out[4 * x + 1] = (uint16_t) ((r + (1 << (rowShift - 1))) >> rowShift);
+      out[4 * x + 2] = (uint16_t) ((g + (1 << (rowShift - 1))) >> rowShift);
+      out[4 * x + 3] = (uint16_t) ((b + (1 << (rowShift - 1))) >> rowShift);
+    }
+  }
+
+  const uint16_t* in;
+  uint32_t* targetLine;
+  for (int y = 0; y < targetHeight; ++y) {
+    for (int i = 0; i < 4 * targetWidth; ++i) {
+      sums[i] = 0;
+    }
+    for (int k = 0; k < spanY; ++k) {
+      weight = weightsY[y * spanY + k];
+      if (weight == 0) {
+        continue;
+      }
+      in = rows + (firstY[y] + k) * 4 * targetWidth;
+      for (int i = 0; i < 4 * targetWidth; ++i) {
+        sums[i] += in[i] * weight;
+      }
+    }
+    targetLine = target + y * targetStride;
+    for (int x = 0; x < targetWidth; ++x) {
+      a = (sums[4 * x] + (1 << (columnShift - 1))) >> columnShift;
+      r = (sums[4 * x + 1] + (1 << (columnShift - 1))) >> columnShift;
+      g = (sums[4 * x + 2] + (1 << (columnShift - 1))) >> columnShift;
+      b = (sums[4 * x + 3] + (1 << (columnShift - 1))) >> columnShift;
+      targetLine[x] = ((uint32_t) a << 24) | ((uint32_t) r << 16) | ((uint32_t) g << 8) | (uint32_t) b;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,19 @@
+#ifndef DOWNSCALE_H
+#define DOWNSCALE_H
+
+// System includes
+#include <stdint.h>
+
+// Detector includes
+#include "frame_view.h"
+#include "workspace.h"
+
+bool downscaleArea(
+    const FrameView& source,
+    uint32_t* target,
+    int targetWidth,
+    int targetHeight,
+    int targetStride,
+    Workspace* workspace = 0);
+
+#endif // DOWNSCALE_H
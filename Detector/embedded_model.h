@@ -0,0 +1,17 @@
+#ifndef EMBEDDED_MODEL_H
+#define EMBEDDED_MODEL_H
+
+// Qt includes
+#include <QSharedPointer>
+
+// Detector includes
+#include "model.h"
+
+/*
+ * The model trained on the training images while building, with the R-tables
+ * compiled in. It is defined in the DetectorEmbeddedModel library, which is
+ * only built with the DETECTOR_EMBED_MODEL option.
+ * */
+QSharedPointer<const Model> embeddedModel();
+
+#endif // EMBEDDED_MODEL_H
@@ -0,0 +1,91 @@
+#include "frame_view.h"
+
+FrameView::FrameView() :
+  data_(0),
+  width_(0),
+  height_(0),
+  stride_(0),
+  format_(Argb32)
+{
+
+}
+
+FrameView::FrameView(const uint8_t* data, int width, int height, int stride, Format format) :
+  data_(data),
+  width_(width),
+  height_(height),
+  stride_(stride),
+  format_(format)
+{
+
+}
+
+bool FrameView::isNull() const
+{
+  return data_ == 0 || width_ <= 0 || height_ <= 0;
+}
+
+bool FrameView::hasColor() const
+{
+  return format_ != Gray8 && format_ != Nv12;
+}
+
+/*
+ * Bytes per pixel of the first plane, for tightly packed rows.
+ * */
+int FrameView::bytesPerPixel(Format format)
+{
+  switch (format) {
+  case Argb32:
+  case Rgba32:
+    return 4;
+  case Rgb24:
+  case Bgr24:
+    return 3;
+  case Gray8:
+  case Nv12:
+    return 1;
+  }
+  return 1;
+}
+
+/*
+ * Returns count pixels of row y, starting at x0, as 32 bit words 0xffRRGGBB
+ * like QImage::Format_RGB32. Argb32 rows are returned in place, the other
+ * formats are converted into buffer, which must hold count words.
+ * */
+const uint32_t* FrameView::row(int y, int x0, int count, uint32_t* buffer) const
+{
+  const uint8_t* line(data_ + y * stride_);
+  const uint8_t* p;
+  switch (format_) {
+  case Argb32:
+    return (const uint32_t*) line + x0;
+  case Rgba32:
+    p = line + 4 * x0;
+    for (int x = 0; x < count; ++x, p += 4) {
+      buffer[x] = 0xff000000u | (p[0] << 16) | (p[1] << 8) | p[2];
+    }
+    break;
+  case Rgb24:
+    p = line + 3 * x0;
+    for (int x = 0; x < count; ++x, p += 3) {
+      buffer[x] = 0xff000000u | (p[0] << 16) | (p[1] << 8) | p[2];
+    }
+    break;
+  case Bgr24:
+    p = line + 3 * x0;
+    for (int x = 0; x < count; ++x, p += 3) {
+      buffer[x] = 0xff000000u | (p[2] << 16) | (p[1] << 8) | p[0];
+    }
+    break;
+  case Gray8:
+  case Nv12:
+    p = line + x0;
+    for (int x = 0; x < count; ++x) {
+      buffer[x] = 0xff000000u | (p[x] << 16) | (p[x] << 8) | p[x];
+    }
+    break;
+  }
+  return buffer;
+}
@@ -0,0 +1,42 @@
+#ifndef FRAME_VIEW_H
+#define FRAME_VIEW_H
+
+// System includes
+#include <stdint.h>
+
+/*
+ * Read only view on pixels owned by someone else, stride bytes per row.
+ * */
+class FrameView
+{
+public:
+  enum Format {
+    // 32 bit words 0xAARRGGBB, as QImage::Format_RGB32 and Format_ARGB32
+    Argb32,
+    // Bytes in memory order
+    Rgba32,
+    Rgb24,
+    Bgr24,
+    Gray8,
+    // Only the luma plane, which comes first, is used
+    Nv12
+  };
+
+  FrameView();
+  FrameView(const uint8_t* data, int width, int height, int stride, Format format);
+
+  bool isNull() const;
+  bool hasColor() const;
+  const uint32_t* row(int y, int x0, int count, uint32_t* buffer) const;
+
+  static int bytesPerPixel(Format format);
+
+public:
+  const uint8_t* data_;
+  int width_;
+  int height_;
+  int stride_;
+  Format format_;
+};
+
+#endif // FRAME_VIEW_H
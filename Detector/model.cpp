@@ -0,0 +1,163 @@
+#include "model.h"
+
+// Qt includes
+#include <qmath.h>
+
+RTable::RTable() :
+  offsetStorage_(keys + 1, 0),
+  offsets_(offsetStorage_.constData()),
+  dx_(dxStorage_.constData()),
+  dy_(dyStorage_.constData())
+{
+
+}
+
+/*
+ * Flattens entries of (angle to the reference point, distance), keyed by
+ * edge angle, into displacements. The displacements are computed the same
+ * way voting did for each entry.
+ * */
+RTable::RTable(const QMultiMap<int, QPair<double, double> >& entries) :
+  offsetStorage_(keys + 1, 0)
+{
+  dxStorage_.reserve(entries.size());
+  dyStorage_.reserve(entries.size());
+
+  QMultiMap<int, QPair<double, double> >::const_iterator entry(entries.constBegin());
+  for (int key = 0; key < keys; ++key) {
+    offsetStorage_[key] = dxStorage_.size();
+    while (entry != entries.constEnd() && entry.key() == key) {
+      dxStorage_.append(entry.value().second * cos(entry.value().first));
+      dyStorage_.append(entry.value().second * sin(entry.value().first));
+      ++entry;
+    }
+  }
+  offsetStorage_[keys] = dxStorage_.size();
+
+  offsets_ = offsetStorage_.constData();
+  dx_ = dxStorage_.constData();
+  dy_ = dyStorage_.constData();
+}
+
+/*
+ * Uses arrays that are kept elsewhere, keys + 1 offsets and as many
+ * displacements as the last offset says. The mapping, if any, is held on to
+ * so the arrays stay valid.
+ * */
+RTable::RTable(const int* offsets, const double* dx, const double* dy, QSharedPointer<QFile> mapping) :
+  mapping_(mapping),
+  offsets_(offsets),
+  dx_(dx),
+  dy_(dy)
+{
+
+}
+
+int RTable::size() const
+{
+  return offsets_[keys];
+}
+
+int RTable::count(int key) const
+{
+  return offsets_[key + 1] - offsets_[key];
+}
+
+const int* RTable::offsets() const
+{
+  return offsets_;
+}
+
+const double* RTable::dx(int key) const
+{
+  return dx_ + offsets_[key];
+}
+
+const double* RTable::dy(int key) const
+{
+  return dy_ + offsets_[key];
+}
+
+TrainingInfo::TrainingInfo() :
+  mode_(Edge),
+  edgeThreshold_(0),
+  harrisThreshold_(0),
+  rTableMaxBinSize_(0),
+  rTableMergeDistance_(0)
+{
+
+}
+
+Model::Model()
+{
+
+}
+
+Model::Model(QMap<Speed, RTable> rTables, QMap<Speed, QSize> trainingSizes, TrainingInfo info) :
+  rTables_(rTables),
+  trainingSizes_(trainingSizes),
+  info_(info)
+{
+
+}
+
+bool Model::isEmpty() const
+{
+  return rTables_.isEmpty();
+}
+
+bool Model::contains(Speed speed) const
+{
+  return rTables_.contains(speed);
+}
+
+QList<Model::Speed> Model::speeds() const
+{
+  return rTables_.keys();
+}
+
+RTable Model::rTable(Speed speed) const
+{
+  return rTables_.value(speed);
+}
+
+QSize Model::trainingSize(Speed speed) const
+{
+  return trainingSizes_.value(speed);
+}
+
+/*
+ * Returns a copy of the model with the R-table and training size of one sign
+ * class added, or replaced.
+ * */
+Model Model::withClass(Speed speed, RTable rTable, QSize trainingSize) const
+{
+  Model model(*this);
+  model.rTables_.insert(speed, rTable);
+  model.trainingSizes_.insert(speed, trainingSize);
+  return model;
+}
+
+/*
+ * Returns a copy of the model that tells it was trained as info says.
+ * */
+Model Model::withInfo(TrainingInfo info) const
+{
+  Model model(*this);
+  model.info_ = info;
+  return model;
+}
+
+TrainingInfo Model::info() const
+{
+  return info_;
+}
+
+int Model::entries() const
+{
+  int entries(0);
+  foreach (RTable rTable, rTables_.values()) {
+    entries += rTable.size();
+  }
+  return entries;
+}
@@ -0,0 +1,102 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+// Qt includes
+#include <QMap>
+#include <QMultiMap>
+#include <QByteArray>
+#include <QFile>
+#include <QPair>
+#include <QSharedPointer>
+#include <QSize>
+#include <QVector>
+
+// Detector includes
+#include "speed_classes.h"
+
+/*
+ * R-table of one sign class, flattened for voting. The entries of each edge
+ * angle key lie next to each other, as the displacement from the edge pixel
+ * to the reference point of the shape.
+ *
+ * The arrays are either owned by the table, compiled in, or lie in a model
+ * file mapped into memory, which then stays mapped as long as a table uses
+ * it.
+ * */
+class RTable
+{
+public:
+  RTable();
+  explicit RTable(const QMultiMap<int, QPair<double, double> >& entries);
+  RTable(const int* offsets, const double* dx, const double* dy, QSharedPointer<QFile> mapping = QSharedPointer<QFile>());
+
+  int size() const;
+  int count(int key) const;
+  const int* offsets() const;
+  const double* dx(int key) const;
+  const double* dy(int key) const;
+
+public:
+  // Keys are gray values of the edge angles
+  static const int keys = 256;
+
+private:
+  QVector<int> offsetStorage_;
+  QVector<double> dxStorage_;
+  QVector<double> dyStorage_;
+  QSharedPointer<QFile> mapping_;
+
+  const int* offsets_;
+  const double* dx_;
+  const double* dy_;
+};
+
+/*
+ * How a model was trained. Detection has to find edges the same way, so the
+ * thresholds are kept with the model, and the hash of the training images
+ * tells whether a saved model is still up to date.
+ * */
+struct TrainingInfo
+{
+  enum Mode { Edge, Harris };
+
+  TrainingInfo();
+
+  Mode mode_;
+  double edgeThreshold_;
+  double harrisThreshold_;
+  int rTableMaxBinSize_;
+  double rTableMergeDistance_;
+  QByteArray trainingSetHash_;
+};
+
+/*
+ * The outcome of training: an R-table and the training image size for each
+ * sign class. A model does not change once made, so any number of contexts
+ * can detect with it at the same time.
+ * */
+class Model : public SpeedClasses
+{
+public:
+  Model();
+  Model(QMap<Speed, RTable> rTables, QMap<Speed, QSize> trainingSizes, TrainingInfo info = TrainingInfo());
+
+  bool isEmpty() const;
+  bool contains(Speed speed) const;
+  QList<Speed> speeds() const;
+
+  RTable rTable(Speed speed) const;
+  QSize trainingSize(Speed speed) const;
+  int entries() const;
+  TrainingInfo info() const;
+
+  Model withClass(Speed speed, RTable rTable, QSize trainingSize) const;
+  Model withInfo(TrainingInfo info) const;
+
+private:
+  QMap<Speed, RTable> rTables_;
+  QMap<Speed, QSize> trainingSizes_;
+  TrainingInfo info_;
+};
+
+#endif // MODEL_H
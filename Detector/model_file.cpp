@@ -0,0 +1,305 @@
+#include "model_file.h"
+
+// Qt includes
+#include <QSaveFile>
+#include <QTextStream>
+
+// System includes
+#include <string.h>
+
+namespace {
+
+const char magic[8] = { 'S', 'S', 'D', 'M', 'O', 'D', 'E', 'L' };
+const quint32 byteOrderMark = 0x01020304;
+const int maxHashSize = 32;
+const int maxClasses = 64;
+
+struct FileHeader
+{
+  char magic_[8];
+  quint32 version_;
+  quint32 byteOrder_;
+  quint32 mode_;
+  quint32 classes_;
+  double edgeThreshold_;
+  double harrisThreshold_;
+  double rTableMergeDistance_;
+  qint32 rTableMaxBinSize_;
+  quint32 hashSize_;
+  char trainingSetHash_[maxHashSize];
+};
+
+struct FileClass
+{
+  qint32 speed_;
+  qint32 width_;
+  qint32 height_;
+  qint32 entries_;
+  // Byte positions of the arrays in the file
+  quint64 offsets_;
+  quint64 dx_;
+  quint64 dy_;
+};
+
+Q_STATIC_ASSERT(sizeof(FileHeader) == 88);
+Q_STATIC_ASSERT(sizeof(FileClass) == 40);
+Q_STATIC_ASSERT(sizeof(int) == sizeof(qint32));
+
+quint64 align(quint64 position)
+{
+  return (position + 7) & ~quint64(7);
+}
+
+/*
+ * Tells whether count items of itemSize bytes at position lie within the
+ * file, and are aligned for doubles.
+ * */
+bool fits(quint64 position, quint64 count, quint64 itemSize, quint64 fileSize)
+{
+  return position % 8 == 0 &&
+      position <= fileSize &&
+      count <= (fileSize - position) / itemSize;
+}
+
+bool writePadding(QSaveFile* file)
+{
+  static const char zeros[8] = { 0 };
+  qint64 padding(align(file->pos()) - file->pos());
+  return file->write(zeros, padding) == padding;
+}
+
+QString literal(int value)
+{
+  return QString::number(value);
+}
+
+QString literal(double value)
+{
+  // Enough digits to read back the same double
+  return QString::number(value, 'g', 17);
+}
+
+template <typename T>
+void writeArray(QTextStream* out, QString declaration, const T* values, int count)
+{
+  *out << declaration << "[" << qMax(count, 1) << "] = {";
+  for (int i = 0; i < count; ++i) {
+    *out << (i % 8 == 0 ? "\n  " : " ") << literal(values[i]) << (i + 1 < count ? "," : "");
+  }
+  if (count == 0) {
+    // Arrays can not be empty
+    *out << " 0";
+  }
+  *out << "\n};\n\n";
+}
+
+} // namespace
+
+/*
+ * Writes the model to file, replacing it only once it is written completely.
+ * */
+bool ModelFile::save(const Model& model, QString file, QString* error)
+{
+  TrainingInfo info(model.info());
+  QList<Model::Speed> speeds(model.speeds());
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic_, magic, sizeof(magic));
+  header.version_ = version;
+  header.byteOrder_ = byteOrderMark;
+  header.mode_ = info.mode_;
+  header.classes_ = speeds.size();
+  header.edgeThreshold_ = info.edgeThreshold_;
+  header.harrisThreshold_ = info.harrisThreshold_;
+  header.rTableMergeDistance_ = info.rTableMergeDistance_;
+  header.rTableMaxBinSize_ = info.rTableMaxBinSize_;
+  header.hashSize_ = qMin(info.trainingSetHash_.size(), maxHashSize);
+  memcpy(header.trainingSetHash_, info.trainingSetHash_.constData(), header.hashSize_);
+
+  QVector<FileClass> classes(speeds.size());
+  quint64 position(align(sizeof(FileHeader) + speeds.size() * sizeof(FileClass)));
+  for (int i = 0; i < speeds.size(); ++i) {
+    RTable rTable(model.rTable(speeds.at(i)));
+    FileClass& c(classes[i]);
+    c.speed_ = speeds.at(i);
+    c.width_ = model.trainingSize(speeds.at(i)).width();
+    c.height_ = model.trainingSize(speeds.at(i)).height();
+    c.entries_ = rTable.size();
+    c.offsets_ = position;
+    position = align(position + (RTable::keys + 1) * sizeof(qint32));
+    c.dx_ = position;
+    position = align(position + rTable.size() * sizeof(double));
+    c.dy_ = position;
+    position = align(position + rTable.size() * sizeof(double));
+  }
+
+  QSaveFile out(file);
+  bool written(out.open(QIODevice::WriteOnly));
+  written = written && out.write((const char*) &header, sizeof(header)) == sizeof(header);
+  written = written && out.write((const char*) classes.constData(), classes.size() * sizeof(FileClass)) ==
+      qint64(classes.size() * sizeof(FileClass));
+  for (int i = 0; i < speeds.size() && written; ++i) {
+    RTable rTable(model.rTable(speeds.at(i)));
+    qint64 offsetBytes((RTable::keys + 1) * sizeof(qint32));
+    qint64 entryBytes(rTable.size() * sizeof(double));
+    written = writePadding(&out) &&
+        out.write((const char*) rTable.offsets(), offsetBytes) == offsetBytes &&
+        writePadding(&out) &&
+        out.write((const char*) rTable.dx(0), entryBytes) == entryBytes &&
+        writePadding(&out) &&
+        out.write((const char*) rTable.dy(0), entryBytes) == entryBytes;
+  }
+  written = written && writePadding(&out) && out.commit();
+
+  if (!written) {
+    *error = QString("Could not write model file %1: %2").arg(file).arg(out.errorString());
+  }
+  return written;
+}
+
+/*
+ * Maps the model file into memory, checks it, and returns a model using the
+ * mapping. Returns a null pointer, and sets error, if the file can not be
+ * used.
+ * */
+QSharedPointer<const Model> ModelFile::load(QString file, QString* error)
+{
+  QSharedPointer<QFile> mapping(new QFile(file));
+  const uchar* data(NULL);
+  if (mapping->open(QIODevice::ReadOnly) && mapping->size() >= (qint64) sizeof(FileHeader)) {
+    data = mapping->map(0, mapping->size());
+  }
+  if (data == NULL) {
+    *error = QString("Could not read model file %1").arg(file);
+    return QSharedPointer<const Model>();
+  }
+  quint64 fileSize(mapping->size());
+
+  const FileHeader* header((const FileHeader*) data);
+  if (memcmp(header->magic_, magic, sizeof(magic)) != 0) {
+    *error = QString("%1 is not a model file").arg(file);
+    return QSharedPointer<const Model>();
+  }
+  if (header->byteOrder_ != byteOrderMark) {
+    *error = QString("Model file %1 was written with another byte order").arg(file);
+    return QSharedPointer<const Model>();
+  }
+  if (header->version_ != (quint32) version) {
+    *error = QString("Model file %1 has version %2, only version %3 is supported").arg(
+          file).arg(
+          header->version_).arg(
+          version);
+    return QSharedPointer<const Model>();
+  }
+
+  *error = QString("Model file %1 is damaged").arg(file);
+  if (header->mode_ > (quint32) TrainingInfo::Harris ||
+      header->classes_ > (quint32) maxClasses ||
+      header->hashSize_ > (quint32) maxHashSize ||
+      !fits(sizeof(FileHeader), header->classes_, sizeof(FileClass), fileSize)) {
+    return QSharedPointer<const Model>();
+  }
+
+  TrainingInfo info;
+  info.mode_ = (TrainingInfo::Mode) header->mode_;
+  info.edgeThreshold_ = header->edgeThreshold_;
+  info.harrisThreshold_ = header->harrisThreshold_;
+  info.rTableMergeDistance_ = header->rTableMergeDistance_;
+  info.rTableMaxBinSize_ = header->rTableMaxBinSize_;
+  info.trainingSetHash_ = QByteArray(header->trainingSetHash_, header->hashSize_);
+
+  QMap<Model::Speed, RTable> rTables;
+  QMap<Model::Speed, QSize> trainingSizes;
+  const FileClass* classes((const FileClass*) (data + sizeof(FileHeader)));
+  const int* offsets;
+  for (quint32 i = 0; i < header->classes_; ++i) {
+    const FileClass& c(classes[i]);
+    if (c.speed_ < Model::NoSpeed || c.speed_ > Model::HundredTwenty ||
+        c.width_ <= 0 || c.height_ <= 0 || c.entries_ < 0 ||
+        !fits(c.offsets_, RTable::keys + 1, sizeof(qint32), fileSize) ||
+        !fits(c.dx_, c.entries_, sizeof(double), fileSize) ||
+        !fits(c.dy_, c.entries_, sizeof(double), fileSize)) {
+      return QSharedPointer<const Model>();
+    }
+    // Voting trusts the offsets, so they have to stay within the entries
+    offsets = (const int*) (data + c.offsets_);
+    if (offsets[0] != 0 || offsets[RTable::keys] != c.entries_) {
+      return QSharedPointer<const Model>();
+    }
+    for (int key = 0; key < RTable::keys; ++key) {
+      if (offsets[key + 1] < offsets[key]) {
+        return QSharedPointer<const Model>();
+      }
+    }
+    rTables.insert((Model::Speed) c.speed_, RTable(
+                     offsets,
+                     (const double*) (data + c.dx_),
+                     (const double*) (data + c.dy_),
+                     mapping));
+    trainingSizes.insert((Model::Speed) c.speed_, QSize(c.width_, c.height_));
+  }
+
+  error->clear();
+  return QSharedPointer<const Model>(new Model(rTables, trainingSizes, info));
+}
+
+/*
+ * Writes the model as C++ source defining embeddedModel(), with the R-tables
+ * as static arrays, so the model can be built into a program.
+ * */
+bool ModelFile::saveSource(const Model& model, QString file, QString* error)
+{
+  TrainingInfo info(model.info());
+  QList<Model::Speed> speeds(model.speeds());
+  QMap<Model::Speed, QString> names(Model::names());
+
+  QSaveFile out(file);
+  if (!out.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    *error = QString("Could not write model source %1: %2").arg(file).arg(out.errorString());
+    return false;
+  }
+
+  QTextStream source(&out);
+  source << "// Generated by SpeedSignDetectorModelCompiler, do not edit.\n\n";
+  source << "#include \"embedded_model.h\"\n\n";
+  source << "namespace {\n\n";
+  foreach (Model::Speed speed, speeds) {
+    RTable rTable(model.rTable(speed));
+    source << "// " << names.value(speed) << "\n";
+    writeArray(&source, QString("const int offsets%1").arg(speed), rTable.offsets(), RTable::keys + 1);
+    writeArray(&source, QString("const double dx%1").arg(speed), rTable.dx(0), rTable.size());
+    writeArray(&source, QString("const double dy%1").arg(speed), rTable.dy(0), rTable.size());
+  }
+  source << "} // namespace\n\n";
+
+  source << "QSharedPointer<const Model> embeddedModel()\n";
+  source << "{\n";
+  source << "  QMap<Model::Speed, RTable> rTables;\n";
+  source << "  QMap<Model::Speed, QSize> trainingSizes;\n";
+  foreach (Model::Speed speed, speeds) {
+    source << QString("  rTables.insert((Model::Speed) %1, RTable(offsets%1, dx%1, dy%1));\n").arg(speed);
+    source << QString("  trainingSizes.insert((Model::Speed) %1, QSize(%2, %3));\n").arg(
+                speed).arg(
+                model.trainingSize(speed).width()).arg(
+                model.trainingSize(speed).height());
+  }
+  source << "\n";
+  source << "  TrainingInfo info;\n";
+  source << "  info.mode_ = " << (info.mode_ == TrainingInfo::Edge ? "TrainingInfo::Edge" : "TrainingInfo::Harris") << ";\n";
+  source << "  info.edgeThreshold_ = " << literal(info.edgeThreshold_) << ";\n";
+  source << "  info.harrisThreshold_ = " << literal(info.harrisThreshold_) << ";\n";
+  source << "  info.rTableMaxBinSize_ = " << info.rTableMaxBinSize_ << ";\n";
+  source << "  info.rTableMergeDistance_ = " << literal(info.rTableMergeDistance_) << ";\n";
+  source << "  info.trainingSetHash_ = QByteArray::fromHex(\"" << info.trainingSetHash_.toHex() << "\");\n";
+  source << "\n";
+  source << "  return QSharedPointer<const Model>(new Model(rTables, trainingSizes, info));\n";
+  source << "}\n";
+  source.flush();
+
+  if (source.status() != QTextStream::Ok || !out.commit()) {
+    *error = QString("Could not write model source %1: %2").arg(file).arg(out.errorString());
+    return false;
+  }
+  return true;
+}
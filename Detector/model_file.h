@@ -0,0 +1,31 @@
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+// Qt includes
+#include <QSharedPointer>
+#include <QString>
+
+// Detector includes
+#include "model.h"
+
+/*
+ * Saves models to, and loads them from, a binary file that is mapped into
+ * memory when loading. The R-tables are used right from the mapping, so
+ * loading a model does not depend on its size.
+ *
+ * The file starts with a header holding the training info, followed by one
+ * record per sign class, followed by the arrays of the R-tables, each aligned
+ * to 8 bytes. All numbers are in the byte order of the machine that wrote
+ * the file, which has to be the one reading it.
+ * */
+class ModelFile
+{
+public:
+  static const int version = 1;
+
+  static bool save(const Model& model, QString file, QString* error);
+  static QSharedPointer<const Model> load(QString file, QString* error);
+  static bool saveSource(const Model& model, QString file, QString* error);
+};
+
+#endif // MODEL_FILE_H
@@ -0,0 +1,49 @@
+#include "preprocess_task.h"
+
+TileRowQueue::TileRowQueue(PreprocessJob job) :
+  job_(job),
+  nextRow_(0),
+  rowsDone_(0)
+{
+  tileRows_ = (job_.frame_.height_ + preprocessTileSize - 1) / preprocessTileSize;
+  tileColumns_ = (job_.frame_.width_ + preprocessTileSize - 1) / preprocessTileSize;
+}
+
+void TileRowQueue::work()
+{
+  int row;
+  while ((row = nextRow_.fetchAndAddOrdered(1)) < tileRows_) {
+    int y0(row * preprocessTileSize);
+    int y1(qMin(y0 + preprocessTileSize, job_.frame_.height_));
+    for (int column = 0; column < tileColumns_; ++column) {
+      int x0(column * preprocessTileSize);
+      int x1(qMin(x0 + preprocessTileSize, job_.frame_.width_));
+      preprocessTile(job_, x0, y0, x1, y1);
+    }
+
+    QMutexLocker locker(&mutex_);
+    rowsDone_++;
+    if (rowsDone_ == tileRows_) {
+      rowsFinished_.wakeAll();
+    }
+  }
+}
+
+void TileRowQueue::waitUntilDone()
+{
+  QMutexLocker locker(&mutex_);
+  while (rowsDone_ < tileRows_) {
+    rowsFinished_.wait(&mutex_);
+  }
+}
+
+PreprocessTask::PreprocessTask(QSharedPointer<TileRowQueue> queue) :
+  queue_(queue)
+{
+
+}
+
+void PreprocessTask::run()
+{
+  queue_->work();
+}
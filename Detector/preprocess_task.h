@@ -0,0 +1,50 @@
+#ifndef PREPROCESS_TASK_H
+#define PREPROCESS_TASK_H
+
+// Qt includes
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+
+// Detector includes
+#include "preprocessing.h"
+
+/*
+ * Hands out the rows of tiles of a PreprocessJob to whichever thread asks
+ * first. The thread that created the queue works on it as well, and only
+ * waits for rows already taken by others, so it never depends on tasks that
+ * have not been started by a busy thread pool.
+ * */
+class TileRowQueue
+{
+public:
+  TileRowQueue(PreprocessJob job);
+
+  void work();
+  void waitUntilDone();
+
+private:
+  PreprocessJob job_;
+  int tileRows_;
+  int tileColumns_;
+  QAtomicInt nextRow_;
+
+  QMutex mutex_;
+  QWaitCondition rowsFinished_;
+  int rowsDone_;
+};
+
+class PreprocessTask : public QRunnable
+{
+public:
+  PreprocessTask(QSharedPointer<TileRowQueue> queue);
+
+  void run();
+
+private:
+  QSharedPointer<TileRowQueue> queue_;
+};
+
+#endif // PREPROCESS_TASK_H
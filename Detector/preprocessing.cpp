@@ -0,0 +1,178 @@
+#include "preprocessing.h"
+
+// System includes
+#include "math.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Detector includes
+#include "math_utilities.h"
+
+PreprocessJob::PreprocessJob() :
+  classifier_(0),
+  edgeThreshold_(0),
+  edges_(0),
+  edgeStride_(0),
+  angles_(0),
+  kept_(0)
+{
+
+}
+
+/*
+ * Runs color elimination, grayscale conversion, Sobel and the edge threshold
+ * for the pixels in [x0, x1) x [y0, y1), producing the same edges as running
+ * Detector::eliminateColors() and Detector::sobelEdges() after each other.
+ * The angles of pixels below the edge threshold are left at 0, since only
+ * edge pixels are looked up in the R-tables.
+ *
+ * Sobel needs the gray pixels one pixel around the tile, and the color votes
+ * for those need the classification of one more pixel around. Both are kept
+ * in buffers on the stack, small enough to stay in the L1 cache, and only the
+ * pixels of the tile itself are written, so tiles can run in parallel. Frames
+ * that are not 32 bit (A)RGB are converted a tile row at a time into another
+ * such buffer, the frame itself is never copied.
+ * */
+void preprocessTile(const PreprocessJob& job, int x0, int y0, int x1, int y1)
+{
+  const int haloSize(preprocessTileSize + 4);
+  uint32_t converted[haloSize * haloSize];
+  const uint32_t* lines[haloSize];
+  uint8_t bits[haloSize * haloSize];
+  uint8_t gray[haloSize * haloSize];
+  uint8_t columnSum[haloSize];
+
+  int width(job.frame_.width_);
+  int height(job.frame_.height_);
+
+  // Classified region, two pixels around the tile
+  int cx0(x0 - 2 > 0 ? x0 - 2 : 0);
+  int cy0(y0 - 2 > 0 ? y0 - 2 : 0);
+  int cx1(x1 + 2 < width ? x1 + 2 : width);
+  int cy1(y1 + 2 < height ? y1 + 2 : height);
+  int cw(cx1 - cx0);
+
+  // Gray region, one pixel around the tile
+  int gx0(x0 - 1 > 0 ? x0 - 1 : 0);
+  int gy0(y0 - 1 > 0 ? y0 - 1 : 0);
+  int gx1(x1 + 1 < width ? x1 + 1 : width);
+  int gy1(y1 + 1 < height ? y1 + 1 : height);
+  int gw(gx1 - gx0);
+
+  for (int y = cy0; y < cy1; ++y) {
+    lines[y - cy0] = job.frame_.row(y, cx0, cw, converted + (y - cy0) * cw);
+    if (job.classifier_ != 0) {
+      job.classifier_->classifyRow(lines[y - cy0], cw, bits + (y - cy0) * cw);
+    }
+  }
+
+  uint32_t color;
+  const uint32_t* line;
+  uint8_t* grayLine;
+  const uint8_t* above;
+  const uint8_t* at;
+  const uint8_t* below;
+  int removalVote;
+  bool interiorRow;
+  for (int y = gy0; y < gy1; ++y) {
+    line = lines[y - cy0];
+    grayLine = gray + (y - gy0) * gw;
+    interiorRow = y > 0 && y < height - 1;
+
+    if (job.classifier_ != 0 && interiorRow) {
+      above = bits + (y - 1 - cy0) * cw;
+      at = bits + (y - cy0) * cw;
+      below = bits + (y + 1 - cy0) * cw;
+      for (int x = 0; x < cw; ++x) {
+        columnSum[x] = above[x] + at[x] + below[x];
+      }
+    }
+
+    for (int x = gx0; x < gx1; ++x) {
+      color = line[x - cx0];
+      if (job.classifier_ != 0 && interiorRow && x > 0 && x < width - 1) {
+        removalVote = columnSum[x - 1 - cx0] + columnSum[x - cx0] + columnSum[x + 1 - cx0];
+        if (removalVote > 3) {
+          color = 0;
+        } else if (job.kept_ != 0 && x >= x0 && x < x1 && y >= y0 && y < y1) {
+          job.kept_[y * width + x] = 1;
+        }
+      }
+      // Same as qGray()
+      grayLine[x - gx0] = (((color >> 16) & 0xff) * 11 + ((color >> 8) & 0xff) * 16 + (color & 0xff) * 5) / 32;
+    }
+  }
+
+  // Sobel, with the same masks and orientation as Detector::sobelEdges()
+  const uint8_t* g;
+  int sumX, sumY;
+  int sum;
+  int angle;
+  for (int y = y0; y < y1; ++y) {
+    for (int x = x0; x < x1; ++x) {
+      sum = 0;
+      angle = 0;
+      if (y > 0 && y < height - 1 && x > 0 && x < width - 1) {
+        g = gray + (y - gy0) * gw + (x - gx0);
+        sumX = (g[gw - 1] - g[-gw - 1]) + 2 * (g[gw] - g[-gw]) + (g[gw + 1] - g[-gw + 1]);
+        sumY = (g[-gw - 1] - g[-gw + 1]) + 2 * (g[-1] - g[1]) + (g[gw - 1] - g[gw + 1]);
+        sum = (sumX < 0 ? -sumX : sumX) + (sumY < 0 ? -sumY : sumY);
+        if (sum > 255) {
+          sum = 255;
+        }
+        if (sum < job.edgeThreshold_) {
+          sum = 0;
+        } else {
+          // Angle is between 0 and 180 degrees, where 0 is E/W, 45 is NE/SW and 90 is N/S
+          angle = (int) (atan2upperHalfPlane(sumY, sumX) * (180 / M_PI) + 0.5);
+        }
+      }
+      job.edges_[y * job.edgeStride_ + x] = 0xff000000u | (sum << 16) | (sum << 8) | sum;
+      job.angles_[y * width + x] = angle;
+    }
+  }
+}
+
+/*
+ * Compares the pixels of the frame in [x0, x1) x [y0, y1), which is at most
+ * a tile, with those kept in reference, as 32 bit (A)RGB with the width of
+ * the frame per row. If any channel of any pixel differs by more than
+ * tolerance, or force is set, the tile is copied into reference and true is
+ * returned. Otherwise the reference is left as it was, so slow drift below
+ * the tolerance still adds up to a change.
+ * */
+bool refreshTile(const FrameView& frame, uint32_t* reference, int x0, int y0, int x1, int y1, int tolerance, bool force)
+{
+  uint32_t converted[preprocessTileSize * preprocessTileSize];
+  const uint32_t* lines[preprocessTileSize];
+
+  int w(x1 - x0);
+  bool changed(force);
+  const uint32_t* kept;
+  uint32_t a, b;
+  for (int y = y0; y < y1; ++y) {
+    lines[y - y0] = frame.row(y, x0, w, converted + (y - y0) * w);
+    if (changed) {
+      continue;
+    }
+    kept = reference + y * frame.width_ + x0;
+    if (tolerance <= 0) {
+      changed = memcmp(lines[y - y0], kept, w * sizeof(uint32_t)) != 0;
+      continue;
+    }
+    for (int x = 0; x < w && !changed; ++x) {
+      a = lines[y - y0][x];
+      b = kept[x];
+      changed = abs((int) ((a >> 16) & 0xff) - (int) ((b >> 16) & 0xff)) > tolerance ||
+          abs((int) ((a >> 8) & 0xff) - (int) ((b >> 8) & 0xff)) > tolerance ||
+          abs((int) (a & 0xff) - (int) (b & 0xff)) > tolerance;
+    }
+  }
+
+  if (changed) {
+    for (int y = y0; y < y1; ++y) {
+      memcpy(reference + y * frame.width_ + x0, lines[y - y0], w * sizeof(uint32_t));
+    }
+  }
+  return changed;
+}
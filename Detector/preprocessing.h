@@ -0,0 +1,40 @@
+#ifndef PREPROCESSING_H
+#define PREPROCESSING_H
+
+// System includes
+#include <stdint.h>
+
+// Detector includes
+#include "color_elimination.h"
+#include "frame_view.h"
+
+// Tiles are at most this many pixels wide and high
+const int preprocessTileSize = 64;
+
+/*
+ * The planes and parameters of one fused preprocessing pass, from the pixels
+ * of a frame to thresholded Sobel edges and their angles.
+ * */
+class PreprocessJob
+{
+public:
+  PreprocessJob();
+
+public:
+  FrameView frame_;
+
+  // Color elimination is skipped when there is no classifier
+  const NonRedClassifier* classifier_;
+  double edgeThreshold_;
+
+  uint32_t* edges_;
+  int edgeStride_;
+  int* angles_;
+  // Optional, flags the pixels kept by the color elimination
+  int* kept_;
+};
+
+void preprocessTile(const PreprocessJob& job, int x0, int y0, int x1, int y1);
+bool refreshTile(const FrameView& frame, uint32_t* reference, int x0, int y0, int x1, int y1, int tolerance, bool force);
+
+#endif // PREPROCESSING_H
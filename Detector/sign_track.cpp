@@ -0,0 +1,30 @@
+#include "sign_track.h"
+
+SignTrack::SignTrack() :
+  confidence_(0),
+  foundConfidence_(0),
+  speed_(SpeedClasses::NoSpeed),
+  speedConfidence_(0),
+  classifiedConfidence_(0)
+{
+
+}
+
+/*
+ * The window the sign is expected in next: the last box moved on by the
+ * last velocity, and grown by margin times its size on each side, plus the
+ * distance moved, in case the sign speeds up.
+ * */
+QRect SignTrack::predicted(double margin) const
+{
+  int growX(margin * box_.width() + qAbs(velocity_.x()));
+  int growY(margin * box_.height() + qAbs(velocity_.y()));
+  return box_.translated(velocity_).adjusted(-growX, -growY, growX, growY);
+}
+
+void SignTrack::update(QRect box, double confidence)
+{
+  velocity_ = box.center() - box_.center();
+  box_ = box;
+  confidence_ = confidence;
+}
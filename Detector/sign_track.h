@@ -0,0 +1,36 @@
+#ifndef SIGN_TRACK_H
+#define SIGN_TRACK_H
+
+// Qt includes
+#include <QPoint>
+#include <QRect>
+
+// Detector includes
+#include "speed_classes.h"
+
+/*
+ * A sign followed from frame to frame of a video: where it was last found,
+ * how far it moved since the frame before, and the speed it was classified
+ * as. The location confidence is that of the NoSpeed R-table, relative to
+ * its size, like the speed confidences.
+ * */
+class SignTrack
+{
+public:
+  SignTrack();
+
+  QRect predicted(double margin) const;
+  void update(QRect box, double confidence);
+
+public:
+  QRect box_;
+  QPoint velocity_;
+  double confidence_;
+  double foundConfidence_;
+
+  SpeedClasses::Speed speed_;
+  double speedConfidence_;
+  double classifiedConfidence_;
+};
+
+#endif // SIGN_TRACK_H
@@ -0,0 +1,18 @@
+#include "speed_classes.h"
+
+QMap<SpeedClasses::Speed, QString> SpeedClasses::names()
+{
+  QMap<Speed, QString> speeds;
+  speeds.insert(NoSpeed, "nospeed");
+  speeds.insert(Thirty, "30");
+  speeds.insert(Forty, "40");
+  speeds.insert(Fifty, "50");
+  speeds.insert(Sixty, "60");
+  speeds.insert(Seventy, "70");
+  speeds.insert(Eighty, "80");
+  speeds.insert(Ninety, "90");
+  speeds.insert(Hundred, "100");
+  speeds.insert(HundredTen, "110");
+  speeds.insert(HundredTwenty, "120");
+  return speeds;
+}
@@ -0,0 +1,19 @@
+#ifndef SPEED_CLASSES_H
+#define SPEED_CLASSES_H
+
+// Qt includes
+#include <QMap>
+#include <QString>
+
+/*
+ * The sign classes told apart, with the names used in the training files.
+ * */
+class SpeedClasses
+{
+public:
+  enum Speed { NoSpeed, Thirty, Forty, Fifty, Sixty, Seventy, Eighty, Ninety, Hundred, HundredTen, HundredTwenty };
+
+  static QMap<Speed, QString> names();
+};
+
+#endif // SPEED_CLASSES_H
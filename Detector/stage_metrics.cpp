@@ -0,0 +1,206 @@
+#include "stage_metrics.h"
+
+// Qt includes
+#include <QTextStream>
+#include <qmath.h>
+
+// Smallest latency told apart, in milliseconds, and the growth of the buckets
+static const double bucketMinimum(0.001);
+static const double bucketGrowth(1.05);
+// Up to bucketMinimum * bucketGrowth^bucketCount, about 110 s
+static const int bucketCount(380);
+
+LatencyHistogram::LatencyHistogram() :
+  buckets_(bucketCount, 0),
+  count_(0),
+  sum_(0),
+  min_(0),
+  max_(0)
+{
+
+}
+
+int LatencyHistogram::bucket(double milliseconds)
+{
+  if (milliseconds <= bucketMinimum) {
+    return 0;
+  }
+  int b((int) (log(milliseconds / bucketMinimum) / log(bucketGrowth)));
+  return qBound(0, b, bucketCount - 1);
+}
+
+/*
+ * The geometric middle of the bucket, which is off by at most 2.5% for any
+ * latency in it.
+ * */
+double LatencyHistogram::bucketMiddle(int bucket)
+{
+  return bucketMinimum * pow(bucketGrowth, bucket + 0.5);
+}
+
+void LatencyHistogram::record(double milliseconds)
+{
+  buckets_[bucket(milliseconds)]++;
+  min_ = count_ == 0 ? milliseconds : qMin(min_, milliseconds);
+  max_ = count_ == 0 ? milliseconds : qMax(max_, milliseconds);
+  sum_ += milliseconds;
+  count_++;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+  if (other.count_ == 0) {
+    return;
+  }
+  for (int b = 0; b < bucketCount; ++b) {
+    buckets_[b] += other.buckets_.at(b);
+  }
+  min_ = count_ == 0 ? other.min_ : qMin(min_, other.min_);
+  max_ = count_ == 0 ? other.max_ : qMax(max_, other.max_);
+  sum_ += other.sum_;
+  count_ += other.count_;
+}
+
+qint64 LatencyHistogram::count() const
+{
+  return count_;
+}
+
+double LatencyHistogram::mean() const
+{
+  return count_ > 0 ? sum_ / count_ : 0;
+}
+
+double LatencyHistogram::max() const
+{
+  return max_;
+}
+
+/*
+ * The latency below which p percent of those recorded are, by nearest rank,
+ * as the middle of its bucket but never outside the smallest and largest
+ * latency recorded.
+ * */
+double LatencyHistogram::percentile(double p) const
+{
+  if (count_ == 0) {
+    return 0;
+  }
+  qint64 rank(qMax((qint64) qCeil(p / 100 * count_), (qint64) 1));
+  qint64 seen(0);
+  for (int b = 0; b < bucketCount; ++b) {
+    seen += buckets_.at(b);
+    if (seen >= rank) {
+      return qBound(min_, bucketMiddle(b), max_);
+    }
+  }
+  return max_;
+}
+
+void StageMetrics::record(QString stage, double milliseconds)
+{
+  if (!histograms_.contains(stage)) {
+    stages_ << stage;
+  }
+  histograms_[stage].record(milliseconds);
+}
+
+/*
+ * Records the milliseconds of each stage, like those of one image.
+ * */
+void StageMetrics::record(const QMap<QString, double>& milliseconds)
+{
+  foreach (QString stage, milliseconds.keys()) {
+    record(stage, milliseconds.value(stage));
+  }
+}
+
+void StageMetrics::merge(const StageMetrics& other)
+{
+  foreach (QString stage, other.stages_) {
+    if (!histograms_.contains(stage)) {
+      stages_ << stage;
+    }
+    histograms_[stage].merge(other.histograms_.value(stage));
+  }
+}
+
+bool StageMetrics::isEmpty() const
+{
+  return stages_.isEmpty();
+}
+
+QStringList StageMetrics::stages() const
+{
+  return stages_;
+}
+
+LatencyHistogram StageMetrics::histogram(QString stage) const
+{
+  return histograms_.value(stage);
+}
+
+/*
+ * One line per stage, like
+ *  Edge thinning: 250 times, mean 3.1 ms, p50 3.0 ms, p90 3.6 ms, p99 4.4 ms, max 5.2 ms
+ * */
+QString StageMetrics::report() const
+{
+  QString report;
+  QTextStream out(&report);
+  foreach (QString stage, stages_) {
+    LatencyHistogram h(histograms_.value(stage));
+    out << QString("%1: %2 times, mean %3 ms, p50 %4 ms, p90 %5 ms, p99 %6 ms, max %7 ms").arg(
+             stage).arg(
+             h.count()).arg(
+             h.mean(), 0, 'f', 2).arg(
+             h.percentile(50), 0, 'f', 2).arg(
+             h.percentile(90), 0, 'f', 2).arg(
+             h.percentile(99), 0, 'f', 2).arg(
+             h.max(), 0, 'f', 2) << endl;
+  }
+  return report;
+}
+
+/*
+ * A header line and one line per stage, with the latencies in milliseconds.
+ * */
+QString StageMetrics::toCsv() const
+{
+  QString csv;
+  QTextStream out(&csv);
+  out << "stage,count,mean,p50,p90,p99,max" << endl;
+  foreach (QString stage, stages_) {
+    LatencyHistogram h(histograms_.value(stage));
+    out << QString("\"%1\",%2,%3,%4,%5,%6,%7").arg(
+             QString(stage).replace("\"", "\"\"")).arg(
+             h.count()).arg(
+             h.mean(), 0, 'f', 3).arg(
+             h.percentile(50), 0, 'f', 3).arg(
+             h.percentile(90), 0, 'f', 3).arg(
+             h.percentile(99), 0, 'f', 3).arg(
+             h.max(), 0, 'f', 3) << endl;
+  }
+  return csv;
+}
+
+/*
+ * An object with an object per stage, like
+ *  {"Edge thinning":{"count":250,"mean":3.1,"p50":3.0,"p90":3.6,"p99":4.4,"max":5.2},...}
+ * */
+QJsonObject StageMetrics::toJson() const
+{
+  QJsonObject json;
+  foreach (QString stage, stages_) {
+    LatencyHistogram h(histograms_.value(stage));
+    QJsonObject latency;
+    latency.insert("count", h.count());
+    latency.insert("mean", h.mean());
+    latency.insert("p50", h.percentile(50));
+    latency.insert("p90", h.percentile(90));
+    latency.insert("p99", h.percentile(99));
+    latency.insert("max", h.max());
+    json.insert(stage, latency);
+  }
+  return json;
+}
@@ -0,0 +1,66 @@
+#ifndef STAGE_METRICS_H
+#define STAGE_METRICS_H
+
+// Qt includes
+#include <QJsonObject>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/*
+ * Counts latencies in buckets that grow by 5% each, from 1 us to over
+ * 100 s, so percentiles are known to within a few percent however many
+ * latencies are recorded, in constant memory.
+ * */
+class LatencyHistogram
+{
+public:
+  LatencyHistogram();
+
+  void record(double milliseconds);
+  void merge(const LatencyHistogram& other);
+
+  qint64 count() const;
+  double mean() const;
+  double max() const;
+  double percentile(double p) const;
+
+private:
+  static int bucket(double milliseconds);
+  static double bucketMiddle(int bucket);
+
+private:
+  QVector<qint64> buckets_;
+  qint64 count_;
+  double sum_;
+  double min_;
+  double max_;
+};
+
+/*
+ * A latency histogram for each named step or stage, kept in the order the
+ * names were first recorded. Not locked, so record from one thread, or
+ * merge the metrics of several threads.
+ * */
+class StageMetrics
+{
+public:
+  void record(QString stage, double milliseconds);
+  void record(const QMap<QString, double>& milliseconds);
+  void merge(const StageMetrics& other);
+
+  bool isEmpty() const;
+  QStringList stages() const;
+  LatencyHistogram histogram(QString stage) const;
+
+  QString report() const;
+  QString toCsv() const;
+  QJsonObject toJson() const;
+
+private:
+  QStringList stages_;
+  QMap<QString, LatencyHistogram> histograms_;
+};
+
+#endif // STAGE_METRICS_H
@@ -0,0 +1,123 @@
+#include "trace_recorder.h"
+
+// Qt includes
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtAlgorithms>
+
+TraceRecorder::TraceRecorder()
+{
+  clock_.start();
+}
+
+/*
+ * Microseconds since the recorder was made, the time base of all events.
+ * */
+double TraceRecorder::now() const
+{
+  return clock_.nsecsElapsed() / 1000.0;
+}
+
+void TraceRecorder::begin(QString name, QJsonObject args)
+{
+  record(name, 'B', now(), 0, args);
+}
+
+/*
+ * Ends the span begun last on this thread. Its args are added to those
+ * given at the beginning.
+ * */
+void TraceRecorder::end(QString name, QJsonObject args)
+{
+  record(name, 'E', now(), 0, args);
+}
+
+/*
+ * A span that is only known once it is over, from start for duration
+ * microseconds.
+ * */
+void TraceRecorder::complete(QString name, double start, double duration, QJsonObject args)
+{
+  record(name, 'X', start, duration, args);
+}
+
+void TraceRecorder::record(QString name, char phase, double start, double duration, QJsonObject args)
+{
+  QMutexLocker locker(&mutex_);
+  Qt::HANDLE handle(QThread::currentThreadId());
+  if (!threads_.contains(handle)) {
+    threads_.insert(handle, threads_.size() + 1);
+  }
+
+  Event event;
+  event.name_ = name;
+  event.phase_ = phase;
+  event.start_ = start;
+  event.duration_ = duration;
+  event.thread_ = threads_.value(handle);
+  event.args_ = args;
+  events_.append(event);
+}
+
+/*
+ * Of spans that start at the same time, the longer one holds the other.
+ * */
+bool TraceRecorder::startsEarlier(const Event& a, const Event& b)
+{
+  return a.start_ < b.start_ || (a.start_ == b.start_ && a.duration_ > b.duration_);
+}
+
+/*
+ * Writes the events recorded so far, in the order they started, with the
+ * threads numbered in the order they first recorded.
+ * */
+bool TraceRecorder::save(QString file)
+{
+  QMutexLocker locker(&mutex_);
+
+  // Spans that are recorded when they end come after those inside them
+  QVector<Event> sorted(events_);
+  qStableSort(sorted.begin(), sorted.end(), startsEarlier);
+
+  QJsonArray traceEvents;
+  foreach (int thread, threads_.values()) {
+    QJsonObject args;
+    args.insert("name", QString("Thread %1").arg(thread));
+    QJsonObject metadata;
+    metadata.insert("name", QString("thread_name"));
+    metadata.insert("ph", QString("M"));
+    metadata.insert("pid", 1);
+    metadata.insert("tid", thread);
+    metadata.insert("args", args);
+    traceEvents.append(metadata);
+  }
+  foreach (const Event& e, sorted) {
+    QJsonObject event;
+    event.insert("name", e.name_);
+    event.insert("cat", QString("detector"));
+    event.insert("ph", QString(QChar(e.phase_)));
+    event.insert("ts", e.start_);
+    if (e.phase_ == 'X') {
+      event.insert("dur", e.duration_);
+    }
+    event.insert("pid", 1);
+    event.insert("tid", e.thread_);
+    if (!e.args_.isEmpty()) {
+      event.insert("args", e.args_);
+    }
+    traceEvents.append(event);
+  }
+
+  QJsonObject trace;
+  trace.insert("traceEvents", traceEvents);
+  trace.insert("displayTimeUnit", QString("ms"));
+
+  QFile out(file);
+  if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+  return out.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) >= 0;
+}
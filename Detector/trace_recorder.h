@@ -0,0 +1,52 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+// Qt includes
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+/*
+ * Records what each thread did when, and saves it in the Chrome trace event
+ * format, which chrome://tracing and Perfetto show as a timeline per thread.
+ * Contexts given a recorder add a complete event for each step and each part
+ * of a step they time, callers add begin and end events around whatever
+ * spans steps, like the detection in one image. Any thread may record.
+ * */
+class TraceRecorder
+{
+public:
+  TraceRecorder();
+
+  double now() const;
+  void begin(QString name, QJsonObject args = QJsonObject());
+  void end(QString name, QJsonObject args = QJsonObject());
+  void complete(QString name, double start, double duration, QJsonObject args = QJsonObject());
+
+  bool save(QString file);
+
+private:
+  struct Event
+  {
+    QString name_;
+    char phase_;
+    double start_;
+    double duration_;
+    int thread_;
+    QJsonObject args_;
+  };
+
+  void record(QString name, char phase, double start, double duration, QJsonObject args);
+  static bool startsEarlier(const Event& a, const Event& b);
+
+private:
+  QElapsedTimer clock_;
+  QMutex mutex_;
+  QVector<Event> events_;
+  QHash<Qt::HANDLE, int> threads_;
+};
+
+#endif // TRACE_RECORDER_H
@@ -0,0 +1,87 @@
+#include "training_task.h"
+
+void MessageBuffer::onMessage(QString message)
+{
+  messages_.append(qMakePair(Message, message));
+}
+
+void MessageBuffer::onVerboseMessage(QString message)
+{
+  messages_.append(qMakePair(VerboseMessage, message));
+}
+
+void MessageBuffer::onTiming(QString message)
+{
+  messages_.append(qMakePair(Timing, message));
+}
+
+void MessageBuffer::onItemFound(QRect, int, int)
+{
+  // Training does not find items
+}
+
+void MessageBuffer::onSpeedFound(QRect, double, SpeedClasses::Speed)
+{
+  // Training does not find speeds
+}
+
+void MessageBuffer::replay(DetectorListener* listener)
+{
+  for (int i = 0; i < messages_.size() && listener != NULL; ++i) {
+    switch (messages_.at(i).first) {
+    case Message:
+      listener->onMessage(messages_.at(i).second);
+      break;
+    case VerboseMessage:
+      listener->onVerboseMessage(messages_.at(i).second);
+      break;
+    case Timing:
+      listener->onTiming(messages_.at(i).second);
+      break;
+    }
+  }
+  messages_.clear();
+}
+
+TrainingQueue::TrainingQueue(QList<DetectorContext*> contexts, QList<SpeedClasses::Speed> speeds, QString trainingFolder) :
+  contexts_(contexts),
+  speeds_(speeds),
+  trainingFolder_(trainingFolder),
+  next_(0),
+  classesDone_(0)
+{
+
+}
+
+void TrainingQueue::work()
+{
+  int i;
+  while ((i = next_.fetchAndAddOrdered(1)) < speeds_.size()) {
+    contexts_.at(i)->trainClassImage(speeds_.at(i), trainingFolder_);
+
+    QMutexLocker locker(&mutex_);
+    classesDone_++;
+    if (classesDone_ == speeds_.size()) {
+      classesFinished_.wakeAll();
+    }
+  }
+}
+
+void TrainingQueue::waitUntilDone()
+{
+  QMutexLocker locker(&mutex_);
+  while (classesDone_ < speeds_.size()) {
+    classesFinished_.wait(&mutex_);
+  }
+}
+
+TrainingTask::TrainingTask(QSharedPointer<TrainingQueue> queue) :
+  queue_(queue)
+{
+
+}
+
+void TrainingTask::run()
+{
+  queue_->work();
+}
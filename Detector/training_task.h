@@ -0,0 +1,73 @@
+#ifndef TRAINING_TASK_H
+#define TRAINING_TASK_H
+
+// Qt includes
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+#include <QPair>
+
+// Detector includes
+#include "detector_context.h"
+#include "detector_listener.h"
+
+/*
+ * Keeps the messages of a context training on another thread, to pass them
+ * on in the order of the sign classes once training is done.
+ * */
+class MessageBuffer : public DetectorListener
+{
+public:
+  void onMessage(QString message);
+  void onVerboseMessage(QString message);
+  void onTiming(QString message);
+  void onItemFound(QRect position, int confidence, int order);
+  void onSpeedFound(QRect position, double confidence, SpeedClasses::Speed speed);
+
+  void replay(DetectorListener* listener);
+
+private:
+  enum Kind { Message, VerboseMessage, Timing };
+
+  QList<QPair<Kind, QString> > messages_;
+};
+
+/*
+ * Hands out the sign classes to train to whichever thread asks first, each
+ * class with a context of its own. Like TileRowQueue, the thread that
+ * created the queue works on it as well.
+ * */
+class TrainingQueue
+{
+public:
+  TrainingQueue(QList<DetectorContext*> contexts, QList<SpeedClasses::Speed> speeds, QString trainingFolder);
+
+  void work();
+  void waitUntilDone();
+
+private:
+  QList<DetectorContext*> contexts_;
+  QList<SpeedClasses::Speed> speeds_;
+  QString trainingFolder_;
+  QAtomicInt next_;
+
+  QMutex mutex_;
+  QWaitCondition classesFinished_;
+  int classesDone_;
+};
+
+class TrainingTask : public QRunnable
+{
+public:
+  TrainingTask(QSharedPointer<TrainingQueue> queue);
+
+  void run();
+
+private:
+  QSharedPointer<TrainingQueue> queue_;
+};
+
+#endif // TRAINING_TASK_H
@@ -0,0 +1,83 @@
+#include "workspace.h"
+
+// System includes
+#include <stdint.h>
+#include <stdlib.h>
+
+// Buffers start on a cache line, which also suits any SIMD loads
+static const size_t workspaceAlignment = 64;
+
+Workspace::Workspace() :
+  allocations_(0)
+{
+  for (int i = 0; i < Slots; ++i) {
+    blocks_[i] = NULL;
+    buffers_[i] = NULL;
+    capacity_[i] = 0;
+  }
+}
+
+Workspace::~Workspace()
+{
+  for (int i = 0; i < Slots; ++i) {
+    free(blocks_[i]);
+  }
+}
+
+/*
+ * Returns the buffer of the slot, with room for at least bytes bytes. Its
+ * contents are kept as long as it is large enough, and are undefined after
+ * it had to grow. Returns NULL if it could not grow.
+ * */
+void* Workspace::buffer(Slot slot, size_t bytes)
+{
+  if (bytes <= capacity_[slot] && buffers_[slot] != NULL) {
+    return buffers_[slot];
+  }
+
+  free(blocks_[slot]);
+  blocks_[slot] = malloc(bytes + workspaceAlignment - 1);
+  if (blocks_[slot] == NULL) {
+    // Failed to allocate memory, abort nicely
+    buffers_[slot] = NULL;
+    capacity_[slot] = 0;
+    return NULL;
+  }
+  allocations_++;
+  buffers_[slot] = (char*) aligned((size_t) (uintptr_t) blocks_[slot]);
+  capacity_[slot] = bytes;
+  return buffers_[slot];
+}
+
+int* Workspace::ints(Slot slot, size_t count)
+{
+  return (int*) buffer(slot, count * sizeof(int));
+}
+
+/*
+ * Counts an allocation made outside the workspace, like a new QImage, in
+ * the allocations reported by takeAllocations().
+ * */
+void Workspace::countAllocation()
+{
+  allocations_++;
+}
+
+/*
+ * Returns the number of allocations since the last call.
+ * */
+int Workspace::takeAllocations()
+{
+  int allocations(allocations_);
+  allocations_ = 0;
+  return allocations;
+}
+
+/*
+ * Rounds bytes up to the alignment of the buffers, so that a buffer can be
+ * split into aligned parts.
+ * */
+size_t Workspace::aligned(size_t bytes)
+{
+  return (bytes + workspaceAlignment - 1) & ~(workspaceAlignment - 1);
+}
@@ -0,0 +1,57 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+// System includes
+#include <stddef.h>
+
+/*
+ * Owns the frame sized buffers of a Detector, one per slot, and hands them
+ * out to the stages that need them. Buffers only grow, so once they fit the
+ * frames of a stream, no more memory is allocated.
+ * */
+class Workspace
+{
+public:
+  enum Slot {
+    SobelAngles,
+    RedPixels,
+    EdgeIntegral,
+    RedIntegral,
+    VoteMask,
+    ProposalMask,
+    Accumulator,
+    RowPixels,
+    ColorRows,
+    GrayPlane,
+    Blur,
+    Downscale,
+    ReferenceFrame,
+    ChangeMask,
+    IncrementalAngles,
+    IncrementalVotes,
+    Slots
+  };
+
+  Workspace();
+  ~Workspace();
+
+  void* buffer(Slot slot, size_t bytes);
+  int* ints(Slot slot, size_t count);
+
+  void countAllocation();
+  int takeAllocations();
+
+  static size_t aligned(size_t bytes);
+
+private:
+  Workspace(const Workspace&);
+  Workspace& operator=(const Workspace&);
+
+private:
+  void* blocks_[Slots];
+  char* buffers_[Slots];
+  size_t capacity_[Slots];
+  int allocations_;
+};
+
+#endif // WORKSPACE_H
@@ -0,0 +1,206 @@
+// Qt Includes
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QLocalSocket>
+#include <QRunnable>
+#include <QStringList>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QVector>
+#include <QtAlgorithms>
+#include <qmath.h>
+
+/*
+ * Sends detection requests to a SpeedSignDetectorCommandLine started with
+ * --daemon, and reports how long the answers took.
+ * */
+
+/*
+ * One connection to the daemon, sending its requests one after the other
+ * and waiting for each answer before sending the next.
+ * */
+class Connection : public QRunnable
+{
+public:
+  Connection(QString server, QStringList requests) :
+    server_(server),
+    requests_(requests)
+  {
+    setAutoDelete(false);
+  }
+
+  void run()
+  {
+    QLocalSocket socket;
+    socket.connectToServer(server_);
+    if (!socket.waitForConnected(5000)) {
+      error_ = socket.errorString();
+      return;
+    }
+
+    QElapsedTimer timer;
+    foreach (QString request, requests_) {
+      timer.start();
+      socket.write(request.toUtf8() + "\n");
+      while (!socket.canReadLine()) {
+        if (!socket.waitForReadyRead(-1)) {
+          error_ = socket.errorString();
+          return;
+        }
+      }
+      replies_ << QString::fromUtf8(socket.readLine()).trimmed();
+      latencies_ << timer.nsecsElapsed() / 1000000.0;
+    }
+    socket.disconnectFromServer();
+  }
+
+  QString server_;
+  QStringList requests_;
+  QStringList replies_;
+  QVector<double> latencies_;
+  QString error_;
+};
+
+/*
+ * The value below which p percent of the sorted values are, by nearest rank.
+ * */
+static double percentile(const QVector<double>& sorted, double p)
+{
+  if (sorted.isEmpty()) {
+    return 0;
+  }
+  int rank(qCeil(p / 100 * sorted.size()));
+  return sorted.at(qBound(0, rank - 1, sorted.size() - 1));
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+  setlocale(LC_NUMERIC,"C");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Speed Sign Detector Client");
+  parser.addHelpOption();
+  parser.addPositionalArgument("files", "Image files to detect in.", "[files...]");
+
+  QCommandLineOption serverOption(QStringList() << "s" << "server",
+          "Send the requests to the daemon listening on the local socket <name>.",
+          "name");
+  parser.addOption(serverOption);
+
+  QCommandLineOption connectionsOption(QStringList() << "c" << "connections",
+          "Send the requests on <connections> connections at the same time.",
+          "connections",
+          "1");
+  parser.addOption(connectionsOption);
+
+  QCommandLineOption repeatOption(QStringList() << "n" << "repeat",
+          "Ask for the detection in each file <times> times.",
+          "times",
+          "1");
+  parser.addOption(repeatOption);
+
+  QCommandLineOption statsOption(QStringList() << "stats",
+          "Print the statistics of the daemon after the detections.");
+  parser.addOption(statsOption);
+
+  QCommandLineOption shutdownOption(QStringList() << "shutdown",
+          "Shut the daemon down after the detections.");
+  parser.addOption(shutdownOption);
+
+  QCommandLineOption quietOption(QStringList() << "q" << "quiet",
+          "Only print the summary, not the answers.");
+  parser.addOption(quietOption);
+
+  parser.process(a);
+
+  QTextStream out(stdout);
+
+  QString server(parser.value(serverOption));
+  if (server.isEmpty()) {
+    out << "A server is required, give one using --server <name>." << endl;
+    return 1;
+  }
+
+  // The daemon may run in another directory
+  QStringList requests;
+  for (int i = 0; i < parser.value(repeatOption).toInt(); ++i) {
+    foreach (QString file, parser.positionalArguments()) {
+      requests << "detect " + QFileInfo(file).absoluteFilePath();
+    }
+  }
+
+  int connections(qBound(1, parser.value(connectionsOption).toInt(), qMax(requests.size(), 1)));
+  QList<Connection*> runs;
+  for (int c = 0; c < connections; ++c) {
+    QStringList share;
+    for (int i = c; i < requests.size(); i += connections) {
+      share << requests.at(i);
+    }
+    runs << new Connection(server, share);
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  QThreadPool pool;
+  pool.setMaxThreadCount(connections);
+  foreach (Connection* run, runs) {
+    pool.start(run);
+  }
+  pool.waitForDone();
+  qint64 elapsed(timer.elapsed());
+
+  int failed(0);
+  QVector<double> latencies;
+  foreach (Connection* run, runs) {
+    if (!run->error_.isEmpty()) {
+      out << QString("Connection failed: %1").arg(run->error_) << endl;
+      failed++;
+    }
+    if (!parser.isSet(quietOption)) {
+      foreach (QString reply, run->replies_) {
+        out << reply << endl;
+      }
+    }
+    latencies += run->latencies_;
+    delete run;
+  }
+
+  if (!requests.isEmpty()) {
+    qSort(latencies);
+    out << QString("Answered %1 of %2 requests on %3 connections in %4 ms, %5 requests/s").arg(
+             latencies.size()).arg(
+             requests.size()).arg(
+             connections).arg(
+             elapsed).arg(
+             elapsed > 0 ? latencies.size() * 1000.0 / elapsed : 0, 0, 'f', 1) << endl;
+    out << QString("Latency p50 %1 ms, p90 %2 ms, p99 %3 ms, max %4 ms").arg(
+             percentile(latencies, 50), 0, 'f', 1).arg(
+             percentile(latencies, 90), 0, 'f', 1).arg(
+             percentile(latencies, 99), 0, 'f', 1).arg(
+             latencies.isEmpty() ? 0 : latencies.last(), 0, 'f', 1) << endl;
+  }
+
+  QStringList commands;
+  if (parser.isSet(statsOption)) {
+    commands << "stats";
+  }
+  if (parser.isSet(shutdownOption)) {
+    commands << "shutdown";
+  }
+  if (!commands.isEmpty()) {
+    Connection control(server, commands);
+    control.run();
+    if (!control.error_.isEmpty()) {
+      out << QString("Connection failed: %1").arg(control.error_) << endl;
+      failed++;
+    }
+    foreach (QString reply, control.replies_) {
+      out << reply << endl;
+    }
+  }
+
+  return failed > 0 ? 2 : 0;
+}
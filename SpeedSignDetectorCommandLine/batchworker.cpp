@@ -0,0 +1,364 @@
+#include "batchworker.h"
+
+// Qt Includes
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QPainter>
+
+// Detector includes
+#include "detection_result.h"
+
+BatchSettings::BatchSettings() :
+  colorElimination_(false),
+  verbose_(false),
+  deadline_(-1),
+  tracking_(false),
+  incremental_(false),
+  tiled_(false),
+  rawFormat_(FrameView::Rgb24),
+  detectionColor_(0, 171, 0),
+  trace_(NULL)
+{
+
+}
+
+BatchFrame::BatchFrame() :
+  index_(0),
+  loaded_(false),
+  client_(0)
+{
+
+}
+
+/*
+ * The findings as a JSON object, like
+ *  {"index":3,"file":"a.jpg","loaded":true,
+ *  "sourceSize":{"width":4000,"height":3000},
+ *  "detectedSize":{"width":600,"height":450},"signs":[{"x":310,"y":122,
+ *  "width":41,"height":41,"speed":"50","confidence":0.82,"scores":{...}}],
+ *  "stages":{"decode":4.1,...},"steps":{"Preprocessing":2.3,...}}
+ * with the boxes of the signs in the image of detectedSize, which is the
+ * image of sourceSize shrunk unless it is detected in tiles, the confidence
+ * of every speed compared in the scores, and the milliseconds spent in the
+ * pipeline stages and the detector steps.
+ * */
+QJsonObject BatchFrame::record() const
+{
+  QMap<SpeedClasses::Speed, QString> speeds(SpeedClasses::names());
+
+  QJsonArray signs;
+  foreach (Finding finding, found_) {
+    QJsonObject scores;
+    foreach (SpeedClasses::Speed speed, finding.scores_.keys()) {
+      scores.insert(speeds.value(speed), finding.scores_.value(speed));
+    }
+    QJsonObject sign;
+    sign.insert("x", finding.position_.x());
+    sign.insert("y", finding.position_.y());
+    sign.insert("width", finding.position_.width());
+    sign.insert("height", finding.position_.height());
+    sign.insert("speed", speeds.value(finding.speed_));
+    sign.insert("confidence", finding.confidence_);
+    sign.insert("scores", scores);
+    signs.append(sign);
+  }
+
+  QJsonObject stages;
+  foreach (QString stage, stageTimes_.keys()) {
+    stages.insert(stage, stageTimes_.value(stage));
+  }
+  QJsonObject steps;
+  foreach (QString step, stepTimes_.keys()) {
+    steps.insert(step, stepTimes_.value(step));
+  }
+
+  QJsonObject record;
+  record.insert("index", index_);
+  if (!file_.isEmpty()) {
+    record.insert("file", file_);
+  }
+  record.insert("loaded", loaded_);
+  if (sourceSize_.isValid() && detectedSize_.isValid()) {
+    QJsonObject source;
+    source.insert("width", sourceSize_.width());
+    source.insert("height", sourceSize_.height());
+    record.insert("sourceSize", source);
+    QJsonObject detected;
+    detected.insert("width", detectedSize_.width());
+    detected.insert("height", detectedSize_.height());
+    record.insert("detectedSize", detected);
+  }
+  record.insert("signs", signs);
+  record.insert("stages", stages);
+  record.insert("steps", steps);
+  return record;
+}
+
+BatchStage::BatchStage(BatchSettings settings) :
+  settings_(settings),
+  frame_(NULL)
+{
+
+}
+
+void BatchStage::onMessage(QString message)
+{
+  frame_->report_ += message + "\n";
+}
+
+void BatchStage::onVerboseMessage(QString message)
+{
+  if (settings_.verbose_) {
+    onMessage(message);
+  }
+}
+
+void BatchStage::onTiming(QString message)
+{
+  if (settings_.verbose_) {
+    onMessage("Timing: " + message);
+  }
+}
+
+void BatchStage::onItemFound(QRect, int, int)
+{
+  // A separate message is already issued by the context
+}
+
+void BatchStage::onSpeedFound(QRect position, double confidence, SpeedClasses::Speed speed)
+{
+  BatchFrame::Finding finding;
+  finding.position_ = position;
+  finding.confidence_ = confidence;
+  finding.speed_ = speed;
+  // The scores come right before, for the same position
+  finding.scores_ = scores_;
+  scores_.clear();
+  frame_->found_.append(finding);
+}
+
+void BatchStage::onStepTiming(QString step, double milliseconds)
+{
+  frame_->stepTimes_[step] += milliseconds;
+}
+
+void BatchStage::onSpeedScores(QRect, QMap<SpeedClasses::Speed, double> scores)
+{
+  scores_ = scores;
+}
+
+/*
+ * Begins the span of the stage for the frame in the trace, if there is one,
+ * with the file or the index in the stream of the frame.
+ * */
+void BatchStage::beginTrace(QString stage)
+{
+  if (settings_.trace_ == NULL) {
+    return;
+  }
+  QJsonObject args;
+  if (frame_->file_.isEmpty()) {
+    args.insert("index", frame_->index_);
+  } else {
+    args.insert("file", frame_->file_);
+  }
+  settings_.trace_->begin(stage, args);
+}
+
+void BatchStage::endTrace(QString stage, QJsonObject args)
+{
+  if (settings_.trace_ != NULL) {
+    settings_.trace_->end(stage, args);
+  }
+}
+
+FrameDecoder::FrameDecoder(const DetectorContext& settings, BatchSettings batchSettings) :
+  BatchStage(batchSettings)
+{
+  context_.initialize();
+  context_.copySettings(settings);
+  context_.setListener(this);
+}
+
+void FrameDecoder::process(BatchFrame* frame)
+{
+  frame_ = frame;
+  frame_->report_ += "\n";
+  onMessage(QString("Loading target image from %1").arg(frame_->file_));
+  beginTrace("Decode");
+
+  if (settings_.rawSize_.isValid()) {
+    frame_->loaded_ = mapRawFrame();
+  } else {
+    context_.loadImage(frame_->file_);
+    frame_->image_ = context_.image();
+    frame_->sourceSize_ = context_.sourceSize();
+    frame_->loaded_ = !frame_->image_.isNull();
+    if (!frame_->loaded_) {
+      onMessage(QString("Could not load the image %1").arg(frame_->file_));
+    }
+  }
+  endTrace("Decode");
+  frame_ = NULL;
+}
+
+/*
+ * Maps the raw frame into memory, and reads one byte of every page, so the
+ * frame is read from disk here and not while detecting. The mapping lasts
+ * as long as the frame holds on to the file.
+ * */
+bool FrameDecoder::mapRawFrame()
+{
+  QSize size(settings_.rawSize_);
+  int stride(size.width() * FrameView::bytesPerPixel(settings_.rawFormat_));
+  qint64 frameBytes(qint64(stride) * size.height());
+
+  QSharedPointer<QFile> rawFile(new QFile(frame_->file_));
+  uchar* data(NULL);
+  if (rawFile->open(QIODevice::ReadOnly) && rawFile->size() >= frameBytes) {
+    data = rawFile->map(0, frameBytes);
+  }
+  if (data == NULL) {
+    onMessage(QString("Could not read a %1x%2 raw frame from %3").arg(
+                size.width()).arg(
+                size.height()).arg(
+                frame_->file_));
+    return false;
+  }
+
+  volatile uchar touched(0);
+  for (qint64 i = 0; i < frameBytes; i += 4096) {
+    touched += data[i];
+  }
+
+  frame_->rawFile_ = rawFile;
+  frame_->raw_ = FrameView(data, size.width(), size.height(), stride, settings_.rawFormat_);
+  return true;
+}
+
+BatchWorker::BatchWorker(const DetectorContext& settings, QSharedPointer<const Model> model, BatchSettings batchSettings) :
+  BatchStage(batchSettings)
+{
+  context_.initialize();
+  context_.copySettings(settings);
+  context_.setModel(model);
+  context_.setListener(this);
+}
+
+void BatchWorker::process(BatchFrame* frame)
+{
+  frame_ = frame;
+  if (!frame_->loaded_) {
+    frame_ = NULL;
+    return;
+  }
+  beginTrace("Detect");
+
+  if (!frame_->raw_.isNull()) {
+    context_.loadFrame(
+          frame_->raw_.data_,
+          frame_->raw_.width_,
+          frame_->raw_.height_,
+          frame_->raw_.stride_,
+          frame_->raw_.format_);
+    frame_->sourceSize_ = context_.sourceSize();
+  } else {
+    context_.setImage(frame_->image_);
+    // Leave the context the only user of the image, so it is not copied
+    frame_->image_ = QImage();
+  }
+  frame_->detectedSize_ = context_.image().size();
+
+  // Detection works on the image in place, so annotate a copy
+  if (!frame_->resultFile_.isEmpty()) {
+    frame_->target_ = context_.image().copy().convertToFormat(QImage::Format_RGB32);
+  }
+
+  if (settings_.mode_ == "Edge" && settings_.tiled_) {
+    // The image is at its full size, too large to search at once
+    context_.detectTiled(settings_.colorElimination_);
+  } else if (settings_.mode_ == "Edge" && settings_.tracking_) {
+    // The frames are consecutive, follow the signs of the previous ones
+    context_.detectTracked(settings_.colorElimination_);
+  } else if (settings_.mode_ == "Edge" && settings_.incremental_) {
+    // The frames are consecutive, only redo the tiles that changed
+    context_.detectIncremental(settings_.colorElimination_);
+  } else if (settings_.mode_ == "Edge" && settings_.deadline_ >= 0) {
+    DetectionResult result(context_.detectWithin(settings_.colorElimination_, settings_.deadline_));
+    if (!result.located_ && result.partial_) {
+      onMessage(QString("No sign located within %1 ms").arg(settings_.deadline_));
+    } else if (result.partial_) {
+      onMessage(QString("Partial result within %1 ms: speed %2 with confidence %3").arg(
+                  settings_.deadline_).arg(
+                  context_.speeds_.value(result.speed_)).arg(
+                  result.speedConfidence_));
+    }
+  } else if (settings_.mode_ == "Edge") {
+    context_.detect(settings_.colorElimination_);
+  } else { // "Harris"
+    context_.detectHarris(settings_.colorElimination_);
+  }
+
+  if (settings_.trace_ != NULL) {
+    QJsonObject args;
+    args.insert("edges", context_.edgeCount());
+    args.insert("detections", frame_->found_.size());
+    endTrace("Detect", args);
+  }
+
+  // The raw frame is unmapped with its file
+  context_.releaseFrame();
+  frame_->raw_ = FrameView();
+  frame_->rawFile_.clear();
+  frame_ = NULL;
+}
+
+FrameEncoder::FrameEncoder(BatchSettings batchSettings) :
+  BatchStage(batchSettings),
+  speeds_(SpeedClasses::names())
+{
+
+}
+
+void FrameEncoder::process(BatchFrame* frame)
+{
+  frame_ = frame;
+  if (frame_->loaded_ && !frame_->resultFile_.isEmpty()) {
+    beginTrace("Encode");
+    frame_->report_ += "\n";
+    onMessage(QString("Saving output image to %1").arg(frame_->resultFile_));
+    QElapsedTimer timer;
+    timer.start();
+    annotate(&frame_->target_);
+    onStepTiming("Annotate image", timer.nsecsElapsed() / 1000000.0);
+    timer.start();
+    frame_->target_.save(frame_->resultFile_);
+    onStepTiming("Encode image", timer.nsecsElapsed() / 1000000.0);
+    endTrace("Encode");
+  }
+  frame_->target_ = QImage();
+  frame_ = NULL;
+}
+
+/*
+ * Draws the signs found, each as a box with its confidence at the top left
+ * and its speed at the bottom right, in white on the image.
+ * */
+void FrameEncoder::annotate(QImage* image)
+{
+  // Text is placed as QGraphicsTextItem did, inside its document margin
+  const QPoint margin(4, 4);
+  const int flags(Qt::AlignLeft | Qt::AlignTop | Qt::TextDontClip);
+
+  QPainter painter(image);
+  foreach (BatchFrame::Finding finding, frame_->found_) {
+    painter.setPen(QPen(settings_.detectionColor_));
+    painter.drawRect(finding.position_);
+    painter.setPen(QPen(Qt::white));
+    painter.drawText(QRect(finding.position_.topLeft() + margin, QSize()), flags,
+                     QString::number(finding.confidence_));
+    painter.drawText(QRect(finding.position_.bottomRight() + margin, QSize()), flags,
+                     speeds_.value(finding.speed_));
+  }
+  painter.end();
+}
@@ -0,0 +1,170 @@
+#ifndef BATCHWORKER_H
+#define BATCHWORKER_H
+
+// Qt Includes
+#include <QColor>
+#include <QFile>
+#include <QImage>
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+#include <QSharedPointer>
+#include <QSize>
+#include <QString>
+
+// SpeedSignDetector Includes
+#include "detector_context.h"
+#include "detector_listener.h"
+#include "trace_recorder.h"
+
+/*
+ * How the target files of a batch are read and detected in.
+ * */
+struct BatchSettings
+{
+  BatchSettings();
+
+  QString mode_;
+  bool colorElimination_;
+  bool verbose_;
+  qint64 deadline_;
+  bool tracking_;
+  bool incremental_;
+  bool tiled_;
+  QSize rawSize_;
+  FrameView::Format rawFormat_;
+  QColor detectionColor_;
+  // Shared by all stages, NULL when not tracing
+  TraceRecorder* trace_;
+};
+
+/*
+ * One target file on its way through the stages, with everything that is to
+ * be printed for it.
+ * */
+struct BatchFrame
+{
+  struct Finding
+  {
+    QRect position_;
+    double confidence_;
+    SpeedClasses::Speed speed_;
+    // Confidence of each speed compared, if they were
+    QMap<SpeedClasses::Speed, double> scores_;
+  };
+
+  BatchFrame();
+
+  QJsonObject record() const;
+
+  int index_;
+  QString file_;
+  QString resultFile_;
+  QString report_;
+  bool loaded_;
+
+  // Either the decoded image, or a raw frame owned by someone else, like
+  // the mapped rawFile_ or the rawBytes_ received by the daemon
+  QImage image_;
+  QSharedPointer<QFile> rawFile_;
+  QByteArray rawBytes_;
+  FrameView raw_;
+
+  // The daemon client that asked for the frame
+  int client_;
+
+  // The size of the image or frame, and the size it was detected in
+  QSize sourceSize_;
+  QSize detectedSize_;
+
+  // A copy of the image as loaded, to draw the findings on
+  QImage target_;
+  QList<Finding> found_;
+
+  // Milliseconds spent in each pipeline stage, and in each detector step
+  QMap<QString, double> stageTimes_;
+  QMap<QString, double> stepTimes_;
+};
+
+/*
+ * A stage of the batch pipeline, working on one frame at a time. Whatever a
+ * stage reports goes into the report of the frame, so stages on different
+ * threads do not mix their output.
+ * */
+class BatchStage : public DetectorListener
+{
+public:
+  BatchStage(BatchSettings settings);
+  virtual ~BatchStage() {}
+
+  virtual void process(BatchFrame* frame) = 0;
+
+  void onMessage(QString message);
+  void onVerboseMessage(QString message);
+  void onTiming(QString message);
+  void onItemFound(QRect position, int confidence, int order);
+  void onSpeedFound(QRect position, double confidence, SpeedClasses::Speed speed);
+  void onStepTiming(QString step, double milliseconds);
+  void onSpeedScores(QRect position, QMap<SpeedClasses::Speed, double> scores);
+
+protected:
+  void beginTrace(QString stage);
+  void endTrace(QString stage, QJsonObject args = QJsonObject());
+
+protected:
+  BatchSettings settings_;
+  BatchFrame* frame_;
+  QMap<SpeedClasses::Speed, double> scores_;
+};
+
+/*
+ * Reads target files: decodes and shrinks images, or maps raw frames and
+ * reads them into memory.
+ * */
+class FrameDecoder : public BatchStage
+{
+public:
+  FrameDecoder(const DetectorContext& settings, BatchSettings batchSettings);
+
+  void process(BatchFrame* frame);
+
+private:
+  bool mapRawFrame();
+
+private:
+  DetectorContext context_;
+};
+
+/*
+ * Detects in the frames with a context of its own, sharing the trained
+ * model with the other workers.
+ * */
+class BatchWorker : public BatchStage
+{
+public:
+  BatchWorker(const DetectorContext& settings, QSharedPointer<const Model> model, BatchSettings batchSettings);
+
+  void process(BatchFrame* frame);
+
+private:
+  DetectorContext context_;
+};
+
+/*
+ * Draws the findings on the result images and saves them.
+ * */
+class FrameEncoder : public BatchStage
+{
+public:
+  FrameEncoder(BatchSettings batchSettings);
+
+  void process(BatchFrame* frame);
+
+private:
+  void annotate(QImage* image);
+
+private:
+  QMap<SpeedClasses::Speed, QString> speeds_;
+};
+
+#endif // BATCHWORKER_H
@@ -0,0 +1,494 @@
+#include "detectiondaemon.h"
+
+// Qt Includes
+#include <QJsonDocument>
+#include <QStringList>
+
+// SpeedSignDetector Includes
+#include "framestream.h"
+
+// System includes
+#include <errno.h>
+#include <unistd.h>
+
+// Raw frames larger than this are refused rather than waited for
+static const qint64 maxFrameBytes(256 * 1024 * 1024);
+
+DaemonClient::DaemonClient() :
+  id_(0),
+  socket_(NULL),
+  output_(NULL),
+  closed_(false),
+  requests_(0),
+  nextReply_(0)
+{
+
+}
+
+DetectionDaemon::DetectionDaemon(const DetectorContext& settings, QSharedPointer<const Model> model,
+                                 BatchSettings batchSettings, int workers, QTextStream* log, QObject* parent) :
+  QObject(parent),
+  settings_(batchSettings),
+  log_(log),
+  stdinNotifier_(NULL),
+  stdinClient_(0),
+  capacity_(4 * qMax(workers, 1)),
+  queued_(0),
+  requests_(capacity_, 1),
+  nextClient_(1),
+  outstanding_(0),
+  shuttingDown_(false),
+  finished_(false)
+{
+  // The workers wait for requests as long as the daemon runs, so the pool
+  // needs a thread for each
+  workers = qMax(workers, 1);
+  pool_.setMaxThreadCount(workers);
+  for (int i = 0; i < workers; ++i) {
+    FrameDecoder* decoder(new FrameDecoder(settings, settings_));
+    BatchWorker* worker(new BatchWorker(settings, model, settings_));
+    stages_.append(QSharedPointer<BatchStage>(decoder));
+    stages_.append(QSharedPointer<BatchStage>(worker));
+    pool_.start(new DaemonWorkerTask(this, &requests_, decoder, worker));
+  }
+}
+
+DetectionDaemon::~DetectionDaemon()
+{
+  if (!finished_) {
+    requests_.producerDone();
+    pool_.waitForDone();
+  }
+}
+
+/*
+ * Listens on the local socket name, or reads requests from stdin and
+ * answers on stdout for "-". A socket left behind by a daemon that did not
+ * shut down cleanly is removed, one that is still answered is not.
+ * */
+bool DetectionDaemon::listen(QString name)
+{
+  if (name == "-") {
+    if (!stdout_.open(STDOUT_FILENO, QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+      *log_ << "Could not open stdout for the answers" << endl;
+      return false;
+    }
+    stdinClient_ = addClient(NULL, &stdout_)->id_;
+    stdinNotifier_ = new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this);
+    connect(stdinNotifier_, SIGNAL(activated(int)), this, SLOT(onStdinReadable()));
+    *log_ << "Answering requests on stdin" << endl;
+    return true;
+  }
+
+  if (!server_.listen(name)) {
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(1000)) {
+      *log_ << QString("Another daemon is listening on %1").arg(name) << endl;
+      return false;
+    }
+    QLocalServer::removeServer(name);
+    if (!server_.listen(name)) {
+      *log_ << QString("Could not listen on %1: %2").arg(name).arg(server_.errorString()) << endl;
+      return false;
+    }
+  }
+  connect(&server_, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+  *log_ << QString("Listening on %1").arg(server_.fullServerName()) << endl;
+  return true;
+}
+
+DaemonClient* DetectionDaemon::addClient(QLocalSocket* socket, QIODevice* output)
+{
+  QSharedPointer<DaemonClient> client(new DaemonClient());
+  client->id_ = nextClient_++;
+  client->socket_ = socket;
+  client->output_ = output;
+  clients_.insert(client->id_, client);
+  if (socket != NULL) {
+    socket->setProperty("client", client->id_);
+  }
+  return client.data();
+}
+
+void DetectionDaemon::onNewConnection()
+{
+  QLocalSocket* socket;
+  while ((socket = server_.nextPendingConnection()) != NULL) {
+    addClient(socket, socket);
+    connect(socket, SIGNAL(readyRead()), this, SLOT(onSocketReadyRead()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(onSocketDisconnected()));
+    if (settings_.verbose_) {
+      *log_ << QString("Client %1 connected").arg(socket->property("client").toInt()) << endl;
+    }
+  }
+}
+
+/*
+ * While the workers have all the frames they can take, what clients send
+ * is left in their sockets, until resumeReading().
+ * */
+void DetectionDaemon::onSocketReadyRead()
+{
+  QLocalSocket* socket(static_cast<QLocalSocket*>(sender()));
+  DaemonClient* client(clients_.value(socket->property("client").toInt()).data());
+  if (client == NULL || client->closed_ || full()) {
+    return;
+  }
+  client->input_.append(socket->readAll());
+  readRequests(client);
+}
+
+void DetectionDaemon::onSocketDisconnected()
+{
+  QLocalSocket* socket(static_cast<QLocalSocket*>(sender()));
+  DaemonClient* client(clients_.value(socket->property("client").toInt()).data());
+  if (client != NULL) {
+    closeClient(client);
+  }
+}
+
+/*
+ * Reads what stdin has, without waiting for more. Stdin ending is taken as
+ * a shutdown request. While the workers have all the frames they can take,
+ * stdin is not read until resumeReading().
+ * */
+void DetectionDaemon::onStdinReadable()
+{
+  if (full()) {
+    stdinNotifier_->setEnabled(false);
+    return;
+  }
+  DaemonClient* client(clients_.value(stdinClient_).data());
+  char buffer[65536];
+  ssize_t bytes(::read(STDIN_FILENO, buffer, sizeof(buffer)));
+  if (bytes < 0 && (errno == EINTR || errno == EAGAIN)) {
+    return;
+  }
+  if (bytes > 0 && client != NULL) {
+    client->input_.append(buffer, bytes);
+    readRequests(client);
+    return;
+  }
+
+  stdinNotifier_->setEnabled(false);
+  shutdown();
+}
+
+/*
+ * Takes the complete requests off the input of the client. A raw frame is
+ * only taken once all of its bytes are in. Once the workers have all the
+ * frames they can take, the rest is left for resumeReading().
+ * */
+void DetectionDaemon::readRequests(DaemonClient* client)
+{
+  QMap<QString, FrameView::Format> formats(FrameStream::rawFormats());
+  int end;
+  while (!client->closed_ && !full() && (end = client->input_.indexOf('\n')) >= 0) {
+    QByteArray line(client->input_.left(end).trimmed());
+    int space(line.indexOf(' '));
+    QString command(QString::fromUtf8(space < 0 ? line : line.left(space)));
+    QString argument(space < 0 ? QString() : QString::fromUtf8(line.mid(space + 1)).trimmed());
+    qint64 consumed(end + 1);
+
+    if (command == "frame") {
+      QStringList words(argument.split(' ', QString::SkipEmptyParts));
+      QStringList dimensions(words.value(0).split('x'));
+      QSize size;
+      if (dimensions.size() == 2) {
+        size = QSize(dimensions.at(0).toInt(), dimensions.at(1).toInt());
+      }
+      qint64 bytes(size.isEmpty() || !formats.contains(words.value(1)) ? 0 :
+                   FrameStream::rawFrameBytes(size, formats.value(words.value(1))));
+      if (bytes <= 0 || bytes > maxFrameBytes) {
+        // Whatever follows can not be told apart from the next requests
+        client->input_.clear();
+        answer(client, takeRequest(client), error("A frame is given as frame <width>x<height> <format>, "
+                                                  "with a format of rgb24, bgr24, rgba32, argb32, gray8 or nv12"));
+        continue;
+      }
+      if (client->input_.size() < consumed + bytes) {
+        return;
+      }
+
+      QSharedPointer<BatchFrame> frame(new BatchFrame());
+      frame->rawBytes_ = client->input_.mid(consumed, bytes);
+      frame->raw_ = FrameView((const uint8_t*) frame->rawBytes_.constData(), size.width(), size.height(),
+                              size.width() * FrameView::bytesPerPixel(formats.value(words.value(1))),
+                              formats.value(words.value(1)));
+      frame->loaded_ = true;
+      client->input_.remove(0, consumed + bytes);
+      submit(client, frame);
+      continue;
+    }
+
+    client->input_.remove(0, consumed);
+    if (command.isEmpty()) {
+      continue;
+    } else if (command == "detect" && !argument.isEmpty()) {
+      QSharedPointer<BatchFrame> frame(new BatchFrame());
+      frame->file_ = argument;
+      submit(client, frame);
+    } else if (command == "stats") {
+      answer(client, takeRequest(client), statistics());
+    } else if (command == "shutdown") {
+      QJsonObject reply;
+      reply.insert("shutdown", true);
+      answer(client, takeRequest(client), reply);
+      shutdown();
+    } else {
+      answer(client, takeRequest(client), error("Unknown request, use detect <file>, frame <width>x<height> <format>, stats or shutdown"));
+    }
+  }
+}
+
+int DetectionDaemon::takeRequest(DaemonClient* client)
+{
+  return client->requests_++;
+}
+
+/*
+ * Queues the frame for the workers, or keeps it pending while they have all
+ * the frames they can take, so the event loop never waits for them.
+ * */
+void DetectionDaemon::submit(DaemonClient* client, QSharedPointer<BatchFrame> frame)
+{
+  int request(takeRequest(client));
+  if (shuttingDown_) {
+    answer(client, request, error("The daemon is shutting down"));
+    return;
+  }
+  frame->client_ = client->id_;
+  frame->index_ = request;
+  client->started_[request].start();
+  outstanding_++;
+  pending_.enqueue(frame);
+  dispatch();
+}
+
+/*
+ * Hands pending frames to the workers as long as there is room, which
+ * keeps the queue from ever being full when pushed to.
+ * */
+void DetectionDaemon::dispatch()
+{
+  while (!pending_.isEmpty() && queued_ < capacity_) {
+    queued_++;
+    requests_.push(pending_.dequeue());
+  }
+}
+
+bool DetectionDaemon::full() const
+{
+  return !pending_.isEmpty();
+}
+
+/*
+ * Takes the requests left in the input and the sockets of the clients while
+ * the workers were full, in the order the clients connected, and reads
+ * stdin again.
+ * */
+void DetectionDaemon::resumeReading()
+{
+  foreach (int id, clients_.keys()) {
+    DaemonClient* client(clients_.value(id).data());
+    if (full()) {
+      return;
+    }
+    if (client == NULL || client->closed_) {
+      continue;
+    }
+    if (client->socket_ != NULL) {
+      client->input_.append(client->socket_->readAll());
+    }
+    readRequests(client);
+  }
+  if (!full() && stdinNotifier_ != NULL && !shuttingDown_) {
+    stdinNotifier_->setEnabled(true);
+  }
+}
+
+void DetectionDaemon::onDetected(int clientId, int request, QJsonObject record, QString report)
+{
+  outstanding_--;
+  queued_--;
+  dispatch();
+  if (settings_.verbose_) {
+    *log_ << report;
+    log_->flush();
+  }
+  QJsonObject stages(record.value("stages").toObject());
+  foreach (QString stage, stages.keys()) {
+    metrics_.record(stage, stages.value(stage).toDouble());
+  }
+  QJsonObject steps(record.value("steps").toObject());
+  foreach (QString step, steps.keys()) {
+    metrics_.record(step, steps.value(step).toDouble());
+  }
+
+  DaemonClient* client(clients_.value(clientId).data());
+  if (client != NULL) {
+    double milliseconds(client->started_.take(request).nsecsElapsed() / 1000000.0);
+    latency_.record(milliseconds);
+    record.insert("latency", milliseconds);
+    answer(client, request, record);
+    if (client->closed_ && client->started_.isEmpty()) {
+      clients_.remove(clientId);
+    }
+  }
+  if (!full()) {
+    resumeReading();
+  }
+  finishIfDone();
+}
+
+/*
+ * Writes the answer once all requests of the client before it are answered.
+ * */
+void DetectionDaemon::answer(DaemonClient* client, int request, QJsonObject record)
+{
+  record.insert("index", request);
+  client->replies_.insert(request, record);
+  while (client->replies_.contains(client->nextReply_)) {
+    QByteArray reply(QJsonDocument(client->replies_.take(client->nextReply_)).toJson(QJsonDocument::Compact));
+    if (!client->closed_) {
+      client->output_->write(reply + "\n");
+    }
+    client->nextReply_++;
+  }
+}
+
+/*
+ * Answers to a client that went away are dropped, and the client is
+ * forgotten once none of its frames is being detected in.
+ * */
+void DetectionDaemon::closeClient(DaemonClient* client)
+{
+  client->closed_ = true;
+  client->replies_.clear();
+  if (client->socket_ != NULL) {
+    client->socket_->deleteLater();
+    client->socket_ = NULL;
+  }
+  if (settings_.verbose_) {
+    *log_ << QString("Client %1 disconnected").arg(client->id_) << endl;
+  }
+  if (client->started_.isEmpty()) {
+    clients_.remove(client->id_);
+  }
+}
+
+/*
+ * Takes no more requests, and finishes once those taken are answered.
+ * */
+void DetectionDaemon::shutdown()
+{
+  if (shuttingDown_) {
+    return;
+  }
+  shuttingDown_ = true;
+  server_.close();
+  if (stdinNotifier_ != NULL) {
+    stdinNotifier_->setEnabled(false);
+  }
+  finishIfDone();
+}
+
+void DetectionDaemon::finishIfDone()
+{
+  if (!shuttingDown_ || outstanding_ > 0 || finished_) {
+    return;
+  }
+  finished_ = true;
+  requests_.producerDone();
+  pool_.waitForDone();
+
+  foreach (QSharedPointer<DaemonClient> client, clients_) {
+    if (client->socket_ != NULL && !client->closed_) {
+      client->socket_->waitForBytesWritten(1000);
+    }
+  }
+
+  *log_ << QString("Answered %1 detection requests from %2 clients, latency p50 %3 ms, p90 %4 ms, p99 %5 ms, max %6 ms").arg(
+             latency_.count()).arg(
+             nextClient_ - 1).arg(
+             latency_.percentile(50), 0, 'f', 1).arg(
+             latency_.percentile(90), 0, 'f', 1).arg(
+             latency_.percentile(99), 0, 'f', 1).arg(
+             latency_.max(), 0, 'f', 1) << endl;
+  *log_ << requests_.statistics("Request") << endl;
+  *log_ << "Latency per image:" << endl << metrics_.report();
+  emit finished();
+}
+
+/*
+ * The detection requests answered so far, the milliseconds from request to
+ * answer below which 50, 90 and 99 percent of them were, and the same for
+ * the pipeline stages and detector steps of each image.
+ * */
+QJsonObject DetectionDaemon::statistics()
+{
+  QJsonObject latency;
+  latency.insert("p50", latency_.percentile(50));
+  latency.insert("p90", latency_.percentile(90));
+  latency.insert("p99", latency_.percentile(99));
+  latency.insert("max", latency_.max());
+
+  QJsonObject statistics;
+  statistics.insert("requests", latency_.count());
+  statistics.insert("pending", outstanding_);
+  statistics.insert("clients", clients_.size());
+  statistics.insert("latency", latency);
+  statistics.insert("stages", metrics_.toJson());
+  return statistics;
+}
+
+/*
+ * The latency of the pipeline stages and detector steps, per image.
+ * */
+StageMetrics DetectionDaemon::metrics() const
+{
+  return metrics_;
+}
+
+QJsonObject DetectionDaemon::error(QString message)
+{
+  QJsonObject reply;
+  reply.insert("error", message);
+  return reply;
+}
+
+DaemonWorkerTask::DaemonWorkerTask(DetectionDaemon* daemon, FrameQueue* requests, FrameDecoder* decoder, BatchWorker* worker) :
+  daemon_(daemon),
+  requests_(requests),
+  decoder_(decoder),
+  worker_(worker)
+{
+
+}
+
+void DaemonWorkerTask::run()
+{
+  QSharedPointer<BatchFrame> frame;
+  QElapsedTimer timer;
+  while (!(frame = requests_->pop()).isNull()) {
+    if (frame->raw_.isNull()) {
+      timer.start();
+      decoder_->process(frame.data());
+      frame->stageTimes_.insert("decode", timer.nsecsElapsed() / 1000000.0);
+    }
+    timer.start();
+    worker_->process(frame.data());
+    frame->stageTimes_.insert("detect", timer.nsecsElapsed() / 1000000.0);
+
+    QJsonObject record(frame->record());
+    if (!frame->loaded_) {
+      record.insert("error", QString("Could not load %1").arg(frame->file_));
+    }
+    QMetaObject::invokeMethod(daemon_, "onDetected", Qt::QueuedConnection,
+                              Q_ARG(int, frame->client_),
+                              Q_ARG(int, frame->index_),
+                              Q_ARG(QJsonObject, record),
+                              Q_ARG(QString, frame->report_));
+  }
+}
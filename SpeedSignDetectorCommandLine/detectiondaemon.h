@@ -0,0 +1,142 @@
+#ifndef DETECTIONDAEMON_H
+#define DETECTIONDAEMON_H
+
+// Qt Includes
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMap>
+#include <QObject>
+#include <QQueue>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QSocketNotifier>
+#include <QTextStream>
+#include <QThreadPool>
+
+// SpeedSignDetector Includes
+#include "batchworker.h"
+#include "pipeline.h"
+#include "stage_metrics.h"
+
+/*
+ * A connection to the daemon, either a local socket or stdin and stdout.
+ * Requests are numbered as they come in, and answered in that order even
+ * when the workers finish them in another.
+ * */
+struct DaemonClient
+{
+  DaemonClient();
+
+  int id_;
+  QLocalSocket* socket_;
+  QIODevice* output_;
+  QByteArray input_;
+  bool closed_;
+
+  int requests_;
+  int nextReply_;
+  QMap<int, QJsonObject> replies_;
+  QMap<int, QElapsedTimer> started_;
+};
+
+/*
+ * Answers detection requests with a model that is loaded or trained once,
+ * on a local socket or on stdin and stdout. Each request is one line:
+ *  detect <file>              detect in an image file
+ *  frame <width>x<height> <format>
+ *                             detect in the raw frame of that many bytes,
+ *                             which follow right after the line
+ *  stats                      the number of requests and their latency
+ *  shutdown                   answer what is pending, then stop
+ * and each answer one JSON line, the record of the frame as described at
+ * BatchFrame::record(), or {"error":...}. Frames are detected in by a fixed
+ * number of workers, each with a context of its own sharing the model, so
+ * requests of several clients are detected in at the same time.
+ * */
+class DetectionDaemon : public QObject
+{
+  Q_OBJECT
+public:
+  DetectionDaemon(const DetectorContext& settings, QSharedPointer<const Model> model,
+                  BatchSettings batchSettings, int workers, QTextStream* log, QObject* parent = 0);
+  ~DetectionDaemon();
+
+  bool listen(QString name);
+  StageMetrics metrics() const;
+
+signals:
+  void finished();
+
+private slots:
+  void onNewConnection();
+  void onSocketReadyRead();
+  void onSocketDisconnected();
+  void onStdinReadable();
+  void onDetected(int client, int request, QJsonObject record, QString report);
+
+private:
+  DaemonClient* addClient(QLocalSocket* socket, QIODevice* output);
+  void readRequests(DaemonClient* client);
+  int takeRequest(DaemonClient* client);
+  void submit(DaemonClient* client, QSharedPointer<BatchFrame> frame);
+  void dispatch();
+  bool full() const;
+  void resumeReading();
+  void answer(DaemonClient* client, int request, QJsonObject record);
+  void closeClient(DaemonClient* client);
+  void shutdown();
+  void finishIfDone();
+  QJsonObject statistics();
+  QJsonObject error(QString message);
+
+private:
+  BatchSettings settings_;
+  QTextStream* log_;
+  QLocalServer server_;
+  QFile stdout_;
+  QSocketNotifier* stdinNotifier_;
+  int stdinClient_;
+
+  // Frames taken but not handed to the workers yet, as the queue and the
+  // workers hold at most capacity_ of them
+  QQueue<QSharedPointer<BatchFrame> > pending_;
+  int capacity_;
+  int queued_;
+  FrameQueue requests_;
+  QThreadPool pool_;
+  QList<QSharedPointer<BatchStage> > stages_;
+
+  QMap<int, QSharedPointer<DaemonClient> > clients_;
+  int nextClient_;
+  int outstanding_;
+  bool shuttingDown_;
+  bool finished_;
+
+  // Milliseconds from request to answer, of each detection
+  LatencyHistogram latency_;
+  StageMetrics metrics_;
+};
+
+/*
+ * Takes frames off the request queue until it is done, detecting in each
+ * and handing the record back to the daemon on its own thread.
+ * */
+class DaemonWorkerTask : public QRunnable
+{
+public:
+  DaemonWorkerTask(DetectionDaemon* daemon, FrameQueue* requests, FrameDecoder* decoder, BatchWorker* worker);
+
+  void run();
+
+private:
+  DetectionDaemon* daemon_;
+  FrameQueue* requests_;
+  FrameDecoder* decoder_;
+  BatchWorker* worker_;
+};
+
+#endif // DETECTIONDAEMON_H
@@ -1,12 +1,29 @@
 #include "detectortask.h"
 
 #include <QDebug>
-#include <QPainter>
-#include <QGraphicsTextItem>
 #include <QDir>
 #include <QFileInfo>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QThreadPool>
+
+// Detector includes
+#include "detectiondaemon.h"
+#include "framestream.h"
+#include "pipeline.h"
+#ifdef DETECTOR_EMBED_MODEL
+#include "embedded_model.h"
+#endif
 
 DetectorTask::DetectorTask(QObject *parent) :
+  deadline_(-1),
+  tracking_(false),
+  incremental_(false),
+  tiled_(false),
+  jobs_(1),
+  decodeThreads_(1),
+  encodeThreads_(1),
+  rawFormat_(FrameView::Rgb24),
   out_(stdout),
   detectionColor1_(0, 171, 0),
   detectionColor2_(255, 255, 84),
@@ -51,47 +68,281 @@ void DetectorTask::setVerbose(bool verbose)
   verbose_ = verbose;
 }
 
-void DetectorTask::detectInImage(QString rFile, QString file)
+void DetectorTask::setDeadline(qint64 deadline)
+{
+  deadline_ = deadline;
+}
+
+/*
+ * Follows the signs from frame to frame of a stream, searching the whole
+ * frame only every fullSearchInterval frames or when a sign is lost.
+ * */
+void DetectorTask::setTracking(int fullSearchInterval)
+{
+  tracking_ = true;
+  detector_.setTracking(fullSearchInterval);
+}
+
+/*
+ * Only redoes the tiles of a stream frame that changed since the frame
+ * before, by more than tolerance levels in any channel.
+ * */
+void DetectorTask::setIncremental(int tolerance)
+{
+  incremental_ = true;
+  detector_.setChangeTolerance(tolerance);
+}
+
+/*
+ * Detects in the images at their full size, in tiles of tileSize pixels,
+ * reporting up to signs signs per image.
+ * */
+void DetectorTask::setTiledDetection(int tileSize, int signs)
+{
+  tiled_ = tileSize > 0;
+  detector_.setTiledDetection(tileSize, signs);
+}
+
+int DetectorTask::minimumTileSize()
+{
+  return detector_.minimumTileSize();
+}
+
+void DetectorTask::setRTablePruning(int maxBinSize, double mergeDistance)
+{
+  detector_.setRTablePruning(maxBinSize, mergeDistance);
+}
+
+void DetectorTask::setDensityFilter(double minEdgeDensity, double minRedDensity)
+{
+  detector_.setDensityFilter(minEdgeDensity, minRedDensity);
+}
+
+void DetectorTask::setRedProposals(bool redProposals)
+{
+  detector_.setRedProposals(redProposals);
+}
+
+void DetectorTask::setPreprocessThreads(int threads)
+{
+  detector_.setPreprocessThreads(threads);
+}
+
+void DetectorTask::setBlurSigma(double sigma)
+{
+  detector_.setBlurSigma(sigma);
+}
+
+void DetectorTask::setTrainingThreads(int threads)
+{
+  detector_.setTrainingThreads(threads);
+}
+
+/*
+ * Detects in up to jobs target files at the same time.
+ * */
+void DetectorTask::setJobs(int jobs)
+{
+  jobs_ = qMax(jobs, 1);
+}
+
+/*
+ * Sets the number of threads that read and decode target files, and that
+ * annotate and save result images, while others detect.
+ * */
+void DetectorTask::setPipelineThreads(int decodeThreads, int encodeThreads)
+{
+  decodeThreads_ = qMax(decodeThreads, 1);
+  encodeThreads_ = qMax(encodeThreads, 1);
+}
+
+/*
+ * Reads frames from streamFile, or from stdin if it is "-", instead of
+ * detecting in target files. Stdout then only gets one record per frame,
+ * all other output goes to stderr.
+ * */
+void DetectorTask::setStreamFile(QString streamFile)
 {
-  out_ << endl << QString("Loading target image from %1").arg(file) << endl;
-  detector_.loadImage(file);
+  streamFile_ = streamFile;
+  if (!streamFile_.isEmpty()) {
+    moveMessagesToStderr();
+  }
+}
+
+/*
+ * Answers detection requests on the local socket name, or on stdin and
+ * stdout for "-", until asked to shut down, instead of detecting in target
+ * files. All other output goes to stderr.
+ * */
+void DetectorTask::setDaemon(QString name)
+{
+  daemonName_ = name;
+  if (!daemonName_.isEmpty()) {
+    moveMessagesToStderr();
+  }
+}
 
-  if (!rFile.isEmpty()) {
-    scene_.clear();
-    scene_.addPixmap(detector_.getPixmap());
-    scene_.setSceneRect(detector_.getImageSize());
+/*
+ * Prints the findings as "text", or as "jsonl" with one JSON record per
+ * target file or frame on stdout, and all other output on stderr.
+ * */
+void DetectorTask::setFormat(QString format)
+{
+  format_ = format;
+  if (format_ == "jsonl") {
+    moveMessagesToStderr();
   }
+}
+
+/*
+ * Writes the latency percentiles of each pipeline stage and detector step
+ * to metricsFile at the end, as CSV if its name ends in .csv and as JSON
+ * otherwise.
+ * */
+void DetectorTask::setMetricsFile(QString metricsFile)
+{
+  metricsFile_ = metricsFile;
+}
 
-  if (mode_ == "Edge") {
-    detector_.detect(colorElimination_);
-  } else { // "Harris"
-    detector_.detectHarris(colorElimination_);
+/*
+ * Records when each thread did which step, for each image, and writes it to
+ * traceFile at the end in the Chrome trace event format.
+ * */
+void DetectorTask::setTraceFile(QString traceFile)
+{
+  traceFile_ = traceFile;
+  if (!traceFile_.isEmpty()) {
+    trace_ = QSharedPointer<TraceRecorder>(new TraceRecorder());
+  } else {
+    trace_.clear();
   }
+  detector_.setTraceRecorder(trace_.data());
+}
 
-  if (!rFile.isEmpty()) {
-    out_ << endl << QString("Saving output image to %1").arg(rFile) << endl;
-    QImage image(scene_.sceneRect().size().toSize(), QImage::Format_RGB32);
-    QPainter painter(&image);
-    scene_.render(&painter);
-    image.save(rFile);
+void DetectorTask::moveMessagesToStderr()
+{
+  if (!messageFile_.isOpen() && messageFile_.open(stderr, QIODevice::WriteOnly)) {
+    out_.setDevice(&messageFile_);
   }
 }
 
+/*
+ * Reads the target files as raw frames of the given size and format, tightly
+ * packed, instead of as image files.
+ * */
+void DetectorTask::setRawFrame(QSize size, FrameView::Format format)
+{
+  rawSize_ = size;
+  rawFormat_ = format;
+}
+
+/*
+ * Detects with the model saved in loadModelFile, instead of training. With a
+ * training directory too, the model is only used if it was trained on the
+ * images there, otherwise the detector is trained again.
+ * */
+void DetectorTask::setLoadModelFile(QString loadModelFile)
+{
+  loadModelFile_ = loadModelFile;
+}
+
+/*
+ * Saves the model to saveModelFile before detecting.
+ * */
+void DetectorTask::setSaveModelFile(QString saveModelFile)
+{
+  saveModelFile_ = saveModelFile;
+}
+
+/*
+ * Loads or trains the model, and saves it if asked to. Without a model file
+ * or training directory, the model built into the program is used, if any.
+ * Returns false if there is no model to detect with.
+ * */
+bool DetectorTask::prepareModel()
+{
+  TrainingInfo::Mode mode(mode_ == "Edge" ? TrainingInfo::Edge : TrainingInfo::Harris);
+
+  bool loaded(false);
+  if (!loadModelFile_.isEmpty()) {
+    out_ << QString("Loading model from %1").arg(loadModelFile_) << endl;
+    loaded = detector_.loadModel(loadModelFile_);
+    if (loaded && detector_.model()->info().mode_ != mode) {
+      out_ << QString("The model was not trained in %1 mode").arg(
+                mode == TrainingInfo::Edge ? "Edge" : "Harris") << endl;
+      loaded = false;
+    } else if (loaded && !trainingDirectory_.isEmpty() &&
+               detector_.model()->info().trainingSetHash_ != detector_.trainingSetHash(trainingDirectory_)) {
+      out_ << "The model was trained on other training images" << endl;
+      loaded = false;
+    }
+  }
+
+#ifdef DETECTOR_EMBED_MODEL
+  if (loadModelFile_.isEmpty() && trainingDirectory_.isEmpty()) {
+    detector_.setModel(embeddedModel());
+    loaded = detector_.model()->info().mode_ == mode;
+    if (!loaded) {
+      out_ << QString("The built in model was not trained in %1 mode").arg(
+                mode == TrainingInfo::Edge ? "Edge" : "Harris") << endl;
+    }
+  }
+#endif
+
+  if (!loaded) {
+    if (trainingDirectory_.isEmpty()) {
+      out_ << "No model to detect with, give a training directory to train one." << endl;
+      return false;
+    }
+    if (mode == TrainingInfo::Edge) {
+      detector_.train(trainingDirectory_);
+    } else {
+      detector_.trainHarris(trainingDirectory_);
+    }
+  }
+
+  if (!saveModelFile_.isEmpty()) {
+    out_ << QString("Saving model to %1").arg(saveModelFile_) << endl;
+    if (!detector_.saveModel(saveModelFile_)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void DetectorTask::run()
 {
-  if (mode_ == "Edge") {
-    detector_.train(trainingDirectory_);
-  } else { // "Harris"
-    detector_.trainHarris(trainingDirectory_);
+  if (!prepareModel()) {
+    emit finished();
+    return;
+  }
+
+  if (!streamFile_.isEmpty()) {
+    detectInStream();
+    writeTrace();
+    emit finished();
+    return;
+  }
+
+  if (!daemonName_.isEmpty()) {
+    // Finishes when asked to shut down
+    DetectionDaemon* daemon(new DetectionDaemon(*detector_.context(), detector_.model(), batchSettings(), jobs_, &out_, this));
+    connect(daemon, SIGNAL(finished()), this, SLOT(onDaemonFinished()));
+    if (!daemon->listen(daemonName_)) {
+      emit finished();
+    }
+    return;
   }
 
   QStringList supportedImageFilter;
-  supportedImageFilter << "*.jpg" << "*.JPG" << "*.JPEG" << "*.jpeg" << "*.png";
+  if (!rawSize_.isValid()) {
+    supportedImageFilter << "*.jpg" << "*.JPG" << "*.JPEG" << "*.jpeg" << "*.png";
+  }
 
   QStringList targetFiles;
   QStringList resultFiles;
   if (QFileInfo(targetFile_).isDir()) {
-    if (!QFileInfo(resultFile_).isDir()) {
+    if (!resultFile_.isEmpty() && !QFileInfo(resultFile_).isDir()) {
       out_ << "Target file is a directory, but result file is not.";
       emit finished();
       return;
@@ -99,7 +350,8 @@ void DetectorTask::run()
     QFileInfoList fiList(QDir(targetFile_).entryInfoList(supportedImageFilter, QDir::Files));
     foreach (QFileInfo f, fiList) {
       targetFiles << f.filePath();
-      resultFiles << resultFile_ + f.fileName();
+      // Without a result directory no result images are drawn
+      resultFiles << (resultFile_.isEmpty() ? QString() : resultFile_ + f.fileName());
     }
   } else {
     targetFiles << targetFile_;
@@ -110,10 +362,243 @@ void DetectorTask::run()
     }
   }
 
-  for (int i = 0; i < targetFiles.length(); ++i) {
-    detectInImage(resultFiles.at(i), targetFiles.at(i));
+  detectInImages(targetFiles, resultFiles);
+  writeTrace();
+
+  emit finished();
+}
+
+/*
+ * Runs the target files through a pipeline, decoding them on decodeThreads_
+ * threads, detecting on jobs_ threads, each with a context of its own
+ * sharing the trained model, and saving the results on encodeThreads_
+ * threads. The reports are printed in the order of the files, each as soon
+ * as it and those before it are done.
+ * */
+void DetectorTask::detectInImages(QStringList targetFiles, QStringList resultFiles)
+{
+  BatchSettings settings(batchSettings());
+
+  QElapsedTimer timer;
+  timer.start();
+
+  int files(targetFiles.size());
+  int decoders(qBound(1, decodeThreads_, files));
+  int jobs(qBound(1, jobs_, files));
+  int encoders(qBound(1, encodeThreads_, files));
+  QSharedPointer<Pipeline> pipeline(new Pipeline(targetFiles, resultFiles, decoders, jobs, encoders));
+
+  // All stages run at the same time, so the pool needs a thread for each
+  QList<QSharedPointer<BatchStage> > stages;
+  QThreadPool pool;
+  pool.setMaxThreadCount(decoders + jobs + encoders);
+  for (int i = 0; i < decoders; ++i) {
+    stages.append(QSharedPointer<BatchStage>(new FrameDecoder(*detector_.context(), settings)));
+    pool.start(new PipelineTask(pipeline, Pipeline::Decode, stages.last().data()));
+  }
+  for (int i = 0; i < jobs; ++i) {
+    stages.append(QSharedPointer<BatchStage>(new BatchWorker(*detector_.context(), detector_.model(), settings)));
+    pool.start(new PipelineTask(pipeline, Pipeline::Detect, stages.last().data()));
+  }
+  for (int i = 0; i < encoders; ++i) {
+    stages.append(QSharedPointer<BatchStage>(new FrameEncoder(settings)));
+    pool.start(new PipelineTask(pipeline, Pipeline::Encode, stages.last().data()));
+  }
+
+  QTextStream records(stdout);
+  StageMetrics metrics;
+  QSharedPointer<BatchFrame> frame;
+  for (int i = 0; i < files; ++i) {
+    frame = pipeline->takeFrame(i);
+    metrics.record(frame->stageTimes_);
+    metrics.record(frame->stepTimes_);
+    out_ << frame->report_;
+    out_.flush();
+    if (format_ == "jsonl") {
+      records << jsonRecord(*frame) << endl;
+    }
+  }
+  pool.waitForDone();
+
+  qint64 elapsed(timer.elapsed());
+  out_ << endl << QString("Detected in %1 images in %2 ms on %3 threads, %4 images/s").arg(
+            files).arg(
+            elapsed).arg(
+            jobs).arg(
+            elapsed > 0 ? files * 1000.0 / elapsed : 0, 0, 'f', 1) << endl;
+  out_ << pipeline->statistics() << endl;
+  reportMetrics(metrics);
+}
+
+BatchSettings DetectorTask::batchSettings()
+{
+  BatchSettings settings;
+  settings.mode_ = mode_;
+  settings.colorElimination_ = colorElimination_;
+  settings.verbose_ = verbose_;
+  settings.deadline_ = deadline_;
+  settings.tracking_ = tracking_;
+  settings.incremental_ = incremental_;
+  settings.tiled_ = tiled_;
+  settings.rawSize_ = rawSize_;
+  settings.rawFormat_ = rawFormat_;
+  settings.detectionColor_ = detectionColor1_;
+  settings.trace_ = trace_.data();
+  return settings;
+}
+
+/*
+ * Detects in the frames of the stream as they come in, with one context
+ * whose buffers are reused from frame to frame. The next frames are read
+ * into a ring of buffers while detecting, so reading and detection overlap.
+ * */
+void DetectorTask::detectInStream()
+{
+  QFile streamFile;
+  bool opened;
+  if (streamFile_ == "-") {
+    opened = streamFile.open(0, QIODevice::ReadOnly | QIODevice::Unbuffered);
+  } else {
+    streamFile.setFileName(streamFile_);
+    opened = streamFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+  }
+  if (!opened) {
+    out_ << QString("Could not open the stream %1").arg(streamFile_) << endl;
+    return;
+  }
+
+  FrameStream stream(&streamFile, rawSize_, rawFormat_);
+  if (!stream.open()) {
+    out_ << stream.error() << endl;
+    return;
   }
 
+  BatchWorker worker(*detector_.context(), detector_.model(), batchSettings());
+  FrameRing ring(&stream, 3);
+  QThreadPool pool;
+  pool.setMaxThreadCount(1);
+  pool.start(new FrameRingTask(&ring));
+
+  QTextStream records(stdout);
+  StageMetrics metrics;
+  QElapsedTimer timer;
+  timer.start();
+  QElapsedTimer frameTimer;
+  int frames(0);
+  FrameView view;
+  while (!(view = ring.next()).isNull()) {
+    frameTimer.start();
+    BatchFrame frame;
+    frame.index_ = frames;
+    frame.loaded_ = true;
+    frame.raw_ = view;
+    worker.process(&frame);
+    ring.release();
+    frame.stageTimes_.insert("detect", frameTimer.nsecsElapsed() / 1000000.0);
+    metrics.record(frame.stageTimes_);
+    metrics.record(frame.stepTimes_);
+
+    out_ << frame.report_;
+    if (format_ == "jsonl") {
+      records << jsonRecord(frame) << endl;
+    } else {
+      records << streamRecord(frame, frame.stageTimes_.value("detect")) << endl;
+    }
+    frames++;
+  }
+  pool.waitForDone();
+
+  if (!stream.error().isEmpty()) {
+    out_ << stream.error() << endl;
+  }
+  qint64 elapsed(timer.elapsed());
+  out_ << QString("Detected in %1 frames in %2 ms, %3 frames/s").arg(
+            frames).arg(
+            elapsed).arg(
+            elapsed > 0 ? frames * 1000.0 / elapsed : 0, 0, 'f', 1) << endl;
+  reportMetrics(metrics);
+}
+
+/*
+ * One line per frame, listing the signs found as
+ *  frame 12: 8.1 ms, speed 50 (confidence 0.82) at 310,122 41x41
+ * */
+QString DetectorTask::streamRecord(const BatchFrame& frame, double milliseconds)
+{
+  QStringList signs;
+  foreach (BatchFrame::Finding finding, frame.found_) {
+    signs << QString("speed %1 (confidence %2) at %3,%4 %5x%6").arg(
+               detector_.speeds_.value(finding.speed_)).arg(
+               finding.confidence_).arg(
+               finding.position_.x()).arg(
+               finding.position_.y()).arg(
+               finding.position_.width()).arg(
+               finding.position_.height());
+  }
+  if (signs.isEmpty()) {
+    signs << "no sign";
+  }
+  return QString("frame %1: %2 ms, %3").arg(
+        frame.index_).arg(
+        milliseconds, 0, 'f', 1).arg(
+        signs.join("; "));
+}
+
+/*
+ * One JSON object per line, as described at BatchFrame::record().
+ * */
+QString DetectorTask::jsonRecord(const BatchFrame& frame)
+{
+  return QString::fromUtf8(QJsonDocument(frame.record()).toJson(QJsonDocument::Compact));
+}
+
+/*
+ * Prints the latency percentiles of each pipeline stage and detector step,
+ * per image, and writes them to the metrics file if one is given.
+ * */
+void DetectorTask::reportMetrics(const StageMetrics& metrics)
+{
+  if (metrics.isEmpty()) {
+    return;
+  }
+  out_ << "Latency per image:" << endl << metrics.report();
+  writeMetrics(metrics);
+}
+
+void DetectorTask::writeMetrics(const StageMetrics& metrics)
+{
+  if (metricsFile_.isEmpty()) {
+    return;
+  }
+  QFile file(metricsFile_);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+    out_ << QString("Could not write the metrics to %1").arg(metricsFile_) << endl;
+    return;
+  }
+  if (metricsFile_.endsWith(".csv", Qt::CaseInsensitive)) {
+    file.write(metrics.toCsv().toUtf8());
+  } else {
+    file.write(QJsonDocument(metrics.toJson()).toJson());
+  }
+}
+
+void DetectorTask::writeTrace()
+{
+  if (trace_.isNull()) {
+    return;
+  }
+  if (trace_->save(traceFile_)) {
+    out_ << QString("Saved the trace to %1").arg(traceFile_) << endl;
+  } else {
+    out_ << QString("Could not write the trace to %1").arg(traceFile_) << endl;
+  }
+}
+
+void DetectorTask::onDaemonFinished()
+{
+  // The daemon prints the metrics itself when it shuts down
+  writeMetrics(static_cast<DetectionDaemon*>(sender())->metrics());
+  writeTrace();
   emit finished();
 }
 
@@ -136,17 +621,7 @@ void DetectorTask::on_issueTiming(QString message)
   }
 }
 
-void DetectorTask::on_speedFound(QRect position, double confidence, Detector::Speed speed)
+void DetectorTask::on_speedFound(QRect, double, Detector::Speed)
 {
-  if (resultFile_.isEmpty()) {
-    // Ignore items found, a separate message is already issued by the Detector.
-    return;
-  }
-  scene_.addRect(position, QPen(detectionColor1_));
-  QGraphicsTextItem* ctext = scene_.addText(QString::number(confidence));
-  QGraphicsTextItem* stext = scene_.addText(detector_.speeds_.value(speed));
-  ctext->setPos(position.topLeft());
-  stext->setPos(position.bottomRight());
-  ctext->setDefaultTextColor(Qt::white);
-  stext->setDefaultTextColor(Qt::white);
+  // Detection happens in the batch workers, which annotate the results
 }
@@ -4,11 +4,16 @@
 // Qt Includes
 #include <QObject>
 #include <QTextStream>
-#include <QGraphicsScene>
 #include <QColor>
+#include <QFile>
+#include <QSize>
+#include <QStringList>
 
 // SpeedSignDetector Includes
 #include "detector.h"
+#include "batchworker.h"
+#include "stage_metrics.h"
+#include "trace_recorder.h"
 
 class DetectorTask : public QObject
 {
@@ -23,13 +28,44 @@ public:
 
   void setColorElimination(bool colorElimination);
   void setVerbose(bool verbose);
+  void setDeadline(qint64 deadline);
+  void setTracking(int fullSearchInterval);
+  void setIncremental(int tolerance);
+  void setTiledDetection(int tileSize, int signs);
+  int minimumTileSize();
+  void setRTablePruning(int maxBinSize, double mergeDistance);
+  void setDensityFilter(double minEdgeDensity, double minRedDensity);
+  void setRedProposals(bool redProposals);
+  void setPreprocessThreads(int threads);
+  void setBlurSigma(double sigma);
+  void setTrainingThreads(int threads);
+  void setJobs(int jobs);
+  void setPipelineThreads(int decodeThreads, int encodeThreads);
+  void setStreamFile(QString streamFile);
+  void setDaemon(QString name);
+  void setFormat(QString format);
+  void setMetricsFile(QString metricsFile);
+  void setTraceFile(QString traceFile);
+  void setRawFrame(QSize size, FrameView::Format format);
+  void setLoadModelFile(QString loadModelFile);
+  void setSaveModelFile(QString saveModelFile);
 
 private:
+  bool prepareModel();
   void loadTrainingImage(QString file);
-  void detectInImage(QString rFile, QString file);
+  BatchSettings batchSettings();
+  void detectInImages(QStringList targetFiles, QStringList resultFiles);
+  void detectInStream();
+  QString streamRecord(const BatchFrame& frame, double milliseconds);
+  QString jsonRecord(const BatchFrame& frame);
+  void reportMetrics(const StageMetrics& metrics);
+  void writeMetrics(const StageMetrics& metrics);
+  void writeTrace();
+  void moveMessagesToStderr();
 
 public slots:
     void run();
+    void onDaemonFinished();
 
     void on_issueMessage(QString message);
     void on_issueVerboseMessage(QString message);
@@ -44,11 +80,26 @@ private:
   QString trainingDirectory_;
   QString targetFile_;
   QString resultFile_;
+  QString loadModelFile_;
+  QString saveModelFile_;
+  QString streamFile_;
+  QString daemonName_;
+  QString format_;
+  QString metricsFile_;
+  QString traceFile_;
+  QSharedPointer<TraceRecorder> trace_;
 
   bool colorElimination_;
   bool verbose_;
-
-  QGraphicsScene scene_;
+  qint64 deadline_;
+  bool tracking_;
+  bool incremental_;
+  bool tiled_;
+  int jobs_;
+  int decodeThreads_;
+  int encodeThreads_;
+  QSize rawSize_;
+  FrameView::Format rawFormat_;
 
   QColor detectionColor1_;
   QColor detectionColor2_;
@@ -57,6 +108,7 @@ private:
   QColor detectionColor5_;
 
   Detector detector_;
+  QFile messageFile_;
   QTextStream out_;
 };
 
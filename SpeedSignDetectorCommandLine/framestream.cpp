@@ -0,0 +1,328 @@
+#include "framestream.h"
+
+// System includes
+#include <ctype.h>
+#include <string.h>
+
+FrameStream::FrameStream(QIODevice* device, QSize rawSize, FrameView::Format rawFormat) :
+  device_(device),
+  kind_(Raw),
+  size_(rawSize),
+  format_(rawFormat),
+  stride_(0),
+  frameBytes_(0)
+{
+
+}
+
+FrameStream::Kind FrameStream::kind() const
+{
+  return kind_;
+}
+
+/*
+ * The reason the stream ended early, empty if it ended after a whole frame.
+ * */
+QString FrameStream::error() const
+{
+  return error_;
+}
+
+/*
+ * Tells the kind of stream, and reads the stream header if it has one. A
+ * stream with a raw frame size is raw whatever its first bytes are, as the
+ * pixels may well look like a header.
+ * */
+bool FrameStream::open()
+{
+  if (!size_.isEmpty()) {
+    kind_ = Raw;
+    stride_ = size_.width() * FrameView::bytesPerPixel(format_);
+    frameBytes_ = rawFrameBytes(size_, format_);
+    return true;
+  }
+
+  char magic[2];
+  if (!readExactly(magic, 2)) {
+    error_ = "The stream is empty";
+    return false;
+  }
+  // Each PPM image starts with its own header, so leave the magic for it
+  pending_ = QByteArray(magic, 2);
+
+  if (memcmp(magic, "P6", 2) == 0) {
+    kind_ = Ppm;
+    return true;
+  }
+  if (memcmp(magic, "YU", 2) == 0) {
+    kind_ = Y4m;
+    return readY4mHeader();
+  }
+
+  error_ = "Raw streams need the frame size, give one using --raw-size <width>x<height>";
+  return false;
+}
+
+/*
+ * The raw frame formats by the names they are given on the command line.
+ * */
+QMap<QString, FrameView::Format> FrameStream::rawFormats()
+{
+  QMap<QString, FrameView::Format> formats;
+  formats.insert("rgb24", FrameView::Rgb24);
+  formats.insert("bgr24", FrameView::Bgr24);
+  formats.insert("rgba32", FrameView::Rgba32);
+  formats.insert("argb32", FrameView::Argb32);
+  formats.insert("gray8", FrameView::Gray8);
+  formats.insert("nv12", FrameView::Nv12);
+  return formats;
+}
+
+/*
+ * The size of a tightly packed raw frame.
+ * */
+qint64 FrameStream::rawFrameBytes(QSize size, FrameView::Format format)
+{
+  qint64 bytes(qint64(size.width()) * FrameView::bytesPerPixel(format) * size.height());
+  if (format == FrameView::Nv12) {
+    // Interleaved chroma at half the resolution, rounded up
+    bytes += qint64((size.width() + 1) / 2 * 2) * ((size.height() + 1) / 2);
+  }
+  return bytes;
+}
+
+/*
+ * Reads the next frame into buffer, reusing its memory, and points view at
+ * it. Returns false at the end of the stream, setting error() if it ended
+ * within a frame or the frame can not be read.
+ * */
+bool FrameStream::readFrame(QByteArray* buffer, FrameView* view)
+{
+  if (!error_.isEmpty() || atEnd()) {
+    return false;
+  }
+
+  QByteArray line;
+  if (kind_ == Ppm && !readPpmHeader()) {
+    return false;
+  }
+  if (kind_ == Y4m && (!readLine(&line) || !line.startsWith("FRAME"))) {
+    error_ = "Missing FRAME header in the Y4M stream";
+    return false;
+  }
+
+  buffer->resize(frameBytes_);
+  if (!readExactly(buffer->data(), frameBytes_)) {
+    error_ = "The stream ended within a frame";
+    return false;
+  }
+  *view = FrameView((const uint8_t*) buffer->constData(), size_.width(), size_.height(), stride_, format_);
+  return true;
+}
+
+bool FrameStream::atEnd()
+{
+  if (!pending_.isEmpty()) {
+    return false;
+  }
+  char c;
+  if (!readExactly(&c, 1)) {
+    return true;
+  }
+  pending_ = QByteArray(&c, 1);
+  return false;
+}
+
+/*
+ * Reads size bytes, waiting for the writer as long as it takes. Returns
+ * false if the stream ends first.
+ * */
+bool FrameStream::readExactly(char* data, qint64 size)
+{
+  qint64 done(qMin(qint64(pending_.size()), size));
+  memcpy(data, pending_.constData(), done);
+  pending_.remove(0, done);
+
+  qint64 read;
+  while (done < size) {
+    read = device_->read(data + done, size - done);
+    if (read <= 0 && !device_->waitForReadyRead(-1)) {
+      return false;
+    }
+    if (read > 0) {
+      done += read;
+    }
+  }
+  return true;
+}
+
+bool FrameStream::readLine(QByteArray* line)
+{
+  line->clear();
+  char c;
+  while (line->size() < 1024) {
+    if (!readExactly(&c, 1)) {
+      return false;
+    }
+    if (c == '\n') {
+      return true;
+    }
+    line->append(c);
+  }
+  return false;
+}
+
+/*
+ * Reads a token of a PPM header, skipping whitespace and comments before it,
+ * and the single whitespace character after it.
+ * */
+bool FrameStream::readPpmToken(QByteArray* token)
+{
+  token->clear();
+  char c;
+  do {
+    if (!readExactly(&c, 1)) {
+      return false;
+    }
+    if (c == '#') {
+      while (c != '\n') {
+        if (!readExactly(&c, 1)) {
+          return false;
+        }
+      }
+    }
+  } while (isspace((unsigned char) c));
+
+  while (!isspace((unsigned char) c) && token->size() < 32) {
+    token->append(c);
+    if (!readExactly(&c, 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FrameStream::readPpmHeader()
+{
+  QByteArray magic, width, height, maxValue;
+  if (!readPpmToken(&magic) || !readPpmToken(&width) || !readPpmToken(&height) || !readPpmToken(&maxValue) ||
+      magic != "P6") {
+    error_ = "Bad PPM header in the stream";
+    return false;
+  }
+  if (maxValue.toInt() != 255 || width.toInt() <= 0 || height.toInt() <= 0) {
+    error_ = "Only 8 bit PPM images are supported";
+    return false;
+  }
+  size_ = QSize(width.toInt(), height.toInt());
+  format_ = FrameView::Rgb24;
+  stride_ = 3 * size_.width();
+  frameBytes_ = qint64(stride_) * size_.height();
+  return true;
+}
+
+/*
+ * Reads the YUV4MPEG2 stream header. Frames are handed on as their luma
+ * plane, the chroma planes are only read past.
+ * */
+bool FrameStream::readY4mHeader()
+{
+  QByteArray line;
+  if (!readLine(&line) || !line.startsWith("YUV4MPEG2")) {
+    error_ = "Bad Y4M header in the stream";
+    return false;
+  }
+
+  QByteArray colorSpace("420");
+  foreach (QByteArray parameter, line.split(' ')) {
+    if (parameter.startsWith('W')) {
+      size_.setWidth(parameter.mid(1).toInt());
+    } else if (parameter.startsWith('H')) {
+      size_.setHeight(parameter.mid(1).toInt());
+    } else if (parameter.startsWith('C')) {
+      colorSpace = parameter.mid(1);
+    }
+  }
+  if (size_.isEmpty()) {
+    error_ = "The Y4M header has no frame size";
+    return false;
+  }
+
+  qint64 luma(qint64(size_.width()) * size_.height());
+  qint64 halfWidth((size_.width() + 1) / 2);
+  qint64 halfHeight((size_.height() + 1) / 2);
+  if (colorSpace.startsWith("420")) {
+    frameBytes_ = luma + 2 * halfWidth * halfHeight;
+  } else if (colorSpace.startsWith("422")) {
+    frameBytes_ = luma + 2 * halfWidth * size_.height();
+  } else if (colorSpace == "444alpha") {
+    frameBytes_ = 4 * luma;
+  } else if (colorSpace.startsWith("444")) {
+    frameBytes_ = 3 * luma;
+  } else if (colorSpace.startsWith("mono")) {
+    frameBytes_ = luma;
+  } else {
+    error_ = QString("Y4M color space %1 is not supported").arg(QString(colorSpace));
+    return false;
+  }
+  format_ = FrameView::Gray8;
+  stride_ = size_.width();
+  return true;
+}
+
+FrameRing::FrameRing(FrameStream* stream, int slots) :
+  stream_(stream),
+  buffers_(slots),
+  views_(slots),
+  free_(slots),
+  filled_(0),
+  nextSlot_(0)
+{
+
+}
+
+/*
+ * Fills the buffers as they become free, until the stream ends. The end is
+ * handed on as a null frame.
+ * */
+void FrameRing::read()
+{
+  int slot(0);
+  bool read(true);
+  while (read) {
+    free_.acquire();
+    read = stream_->readFrame(&buffers_[slot], &views_[slot]);
+    if (!read) {
+      views_[slot] = FrameView();
+    }
+    filled_.release();
+    slot = (slot + 1) % buffers_.size();
+  }
+}
+
+/*
+ * Waits for the next frame, which stays valid until release() is called.
+ * Returns a null frame at the end of the stream.
+ * */
+FrameView FrameRing::next()
+{
+  filled_.acquire();
+  return views_.at(nextSlot_);
+}
+
+void FrameRing::release()
+{
+  nextSlot_ = (nextSlot_ + 1) % buffers_.size();
+  free_.release();
+}
+
+FrameRingTask::FrameRingTask(FrameRing* ring) :
+  ring_(ring)
+{
+
+}
+
+void FrameRingTask::run()
+{
+  ring_->read();
+}
@@ -0,0 +1,93 @@
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+// Qt Includes
+#include <QByteArray>
+#include <QIODevice>
+#include <QMap>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+// SpeedSignDetector Includes
+#include "frame_view.h"
+
+/*
+ * Reads a sequence of frames from a pipe or file, which are raw frames of
+ * the given size and format, tightly packed, or when no size is given, of
+ * the kind told from its first bytes:
+ *  - concatenated binary PPM images (P6), as written by image2pipe,
+ *  - YUV4MPEG2, of which only the luma plane is used.
+ * */
+class FrameStream
+{
+public:
+  enum Kind { Raw, Ppm, Y4m };
+
+  FrameStream(QIODevice* device, QSize rawSize, FrameView::Format rawFormat);
+
+  bool open();
+  bool readFrame(QByteArray* buffer, FrameView* view);
+
+  Kind kind() const;
+  QString error() const;
+
+  static QMap<QString, FrameView::Format> rawFormats();
+  static qint64 rawFrameBytes(QSize size, FrameView::Format format);
+
+private:
+  bool atEnd();
+  bool readExactly(char* data, qint64 size);
+  bool readLine(QByteArray* line);
+  bool readPpmToken(QByteArray* token);
+  bool readPpmHeader();
+  bool readY4mHeader();
+
+private:
+  QIODevice* device_;
+  QByteArray pending_;
+  Kind kind_;
+  QSize size_;
+  FrameView::Format format_;
+  int stride_;
+  qint64 frameBytes_;
+  QString error_;
+};
+
+/*
+ * Reads the frames of a stream on a thread of its own, into a few buffers
+ * that are used over and over, so the next frames are read while detecting
+ * in the current one.
+ * */
+class FrameRing
+{
+public:
+  FrameRing(FrameStream* stream, int slots);
+
+  void read();
+  FrameView next();
+  void release();
+
+private:
+  FrameStream* stream_;
+  QVector<QByteArray> buffers_;
+  QVector<FrameView> views_;
+  QSemaphore free_;
+  QSemaphore filled_;
+  int nextSlot_;
+};
+
+class FrameRingTask : public QRunnable
+{
+public:
+  FrameRingTask(FrameRing* ring);
+
+  void run();
+
+private:
+  FrameRing* ring_;
+};
+
+#endif // FRAMESTREAM_H
@@ -1,18 +1,19 @@
 // Qt Includes
-#include <QApplication>
+#include <QCoreApplication>
+#include <QGuiApplication>
 #include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QScopedPointer>
 #include <QTextStream>
 #include <QTimer>
 #include <QFileInfo>
 
 // SpeedSignDetector Includes
 #include "detectortask.h"
+#include "framestream.h"
 
 int main(int argc, char *argv[])
 {
-  QApplication a(argc, argv);
-  setlocale(LC_NUMERIC,"C");
-
   QCommandLineParser parser;
   parser.setApplicationDescription("Speed Sign Detector Command Line");
   parser.addHelpOption();
@@ -41,10 +42,173 @@ int main(int argc, char *argv[])
           "Eliminate uninteresting colors first.");
   parser.addOption(colorEliminationOption);
 
+  QCommandLineOption deadlineOption(QStringList() << "d" << "deadline",
+          "Stop detecting after <deadline> ms and report the best result so far (Edge mode only).",
+          "deadline");
+  parser.addOption(deadlineOption);
+
+  QCommandLineOption rTableCapOption(QStringList() << "rtable-cap",
+          "Keep at most <cap> R-table entries per angle bin when training.",
+          "cap",
+          "0");
+  parser.addOption(rTableCapOption);
+
+  QCommandLineOption rTableMergeOption(QStringList() << "rtable-merge",
+          "Merge the R-table entries whose displacements share a grid cell of <distance> by <distance> pixels into their mean when training.",
+          "distance",
+          "0");
+  parser.addOption(rTableMergeOption);
+
+  QCommandLineOption edgeDensityOption(QStringList() << "edge-density",
+          "Only let edges vote inside windows holding at least <density> times a sign circumference of edge pixels.",
+          "density",
+          "0");
+  parser.addOption(edgeDensityOption);
+
+  QCommandLineOption redDensityOption(QStringList() << "red-density",
+          "With --eliminate-colors, only let edges vote inside windows with at least a <density> fraction of red pixels.",
+          "density",
+          "0");
+  parser.addOption(redDensityOption);
+
+  QCommandLineOption redProposalsOption(QStringList() << "p" << "red-proposals",
+          "Only look for signs around red regions of sign size.");
+  parser.addOption(redProposalsOption);
+
+  QCommandLineOption preprocessThreadsOption(QStringList() << "preprocess-threads",
+          "Spread the preprocessing of each image over <threads> threads.",
+          "threads",
+          "1");
+  parser.addOption(preprocessThreadsOption);
+
+  QCommandLineOption trainingThreadsOption(QStringList() << "training-threads",
+          "Train the sign classes on <threads> threads, 0 uses one per core.",
+          "threads",
+          "0");
+  parser.addOption(trainingThreadsOption);
+
+  QCommandLineOption blurSigmaOption(QStringList() << "blur-sigma",
+          "Blur the image with a Gaussian of <sigma> pixels before detecting edges, 0 disables blurring.",
+          "sigma",
+          "0");
+  parser.addOption(blurSigmaOption);
+
+  QCommandLineOption rawSizeOption(QStringList() << "raw-size",
+          "Read the target files as raw frames of <width>x<height> pixels.",
+          "size");
+  parser.addOption(rawSizeOption);
+
+  QCommandLineOption rawFormatOption(QStringList() << "raw-format",
+          "Pixel <format> of the raw frames: rgb24, bgr24, rgba32, argb32, gray8 or nv12.",
+          "format",
+          "rgb24");
+  parser.addOption(rawFormatOption);
+
+  QCommandLineOption loadModelOption(QStringList() << "load-model",
+          "Detect with the model saved in <file> instead of training, unless it was trained on other images than those in the training directory.",
+          "file");
+  parser.addOption(loadModelOption);
+
+  QCommandLineOption saveModelOption(QStringList() << "save-model",
+          "Save the model to <file>, for use with --load-model.",
+          "file");
+  parser.addOption(saveModelOption);
+
+  QCommandLineOption streamOption(QStringList() << "s" << "stream",
+          "Detect in the frames read from <file>, or stdin for \"-\", printing one record per frame. The stream holds PPM images, YUV4MPEG2 or raw frames as given by --raw-size and --raw-format.",
+          "file");
+  parser.addOption(streamOption);
+
+  QCommandLineOption daemonOption(QStringList() << "daemon",
+          "Load or train the model once, then answer detection requests on the local socket <name>, or on stdin and stdout for \"-\", with one JSON record per request, until asked to shut down. Requests are detected in on --jobs threads.",
+          "name");
+  parser.addOption(daemonOption);
+
+  QCommandLineOption trackOption(QStringList() << "track",
+          "With --stream, follow the signs found from frame to frame, searching the whole frame only every <frames> frames or when a sign is lost (Edge mode only).",
+          "frames");
+  parser.addOption(trackOption);
+
+  QCommandLineOption incrementalOption(QStringList() << "incremental",
+          "With --stream, only redo the parts of a frame that changed since the frame before, by more than <tolerance> levels in any color channel (Edge mode only, not with --track).",
+          "tolerance");
+  parser.addOption(incrementalOption);
+
+  QCommandLineOption tileOption(QStringList() << "tile",
+          "Detect in the images at their full size instead of shrinking them, searching tiles of <size> pixels at a time (Edge mode only, takes precedence over --track and --incremental).",
+          "size");
+  parser.addOption(tileOption);
+
+  QCommandLineOption tileSignsOption(QStringList() << "tile-signs",
+          "With --tile, report up to <signs> signs per image.",
+          "signs",
+          "1");
+  parser.addOption(tileSignsOption);
+
+  QCommandLineOption formatOption(QStringList() << "f" << "format",
+          "Print the findings as <format> \"text\", or \"jsonl\" for one JSON record per target file or frame on stdout, with all other output on stderr. Result images are only drawn when a result file is given.",
+          "format",
+          "text");
+  parser.addOption(formatOption);
+
+  QCommandLineOption metricsOption(QStringList() << "metrics",
+          "Write the p50, p90, p99 and maximum latency per image of each pipeline stage and detector step to <file>, as CSV if it ends in .csv and as JSON otherwise. They are printed at the end in any case.",
+          "file");
+  parser.addOption(metricsOption);
+
+  QCommandLineOption traceOption(QStringList() << "trace",
+          "Record when each thread did which detector step for each image, and write it to <file> at the end as Chrome trace events, to be opened in chrome://tracing or Perfetto.",
+          "file");
+  parser.addOption(traceOption);
+
+  QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+          "Detect in <jobs> target files at the same time, each on a thread of its own.",
+          "jobs",
+          "1");
+  parser.addOption(jobsOption);
+
+  QCommandLineOption decodeThreadsOption(QStringList() << "decode-threads",
+          "Read and decode target files on <threads> threads, ahead of detection.",
+          "threads",
+          "1");
+  parser.addOption(decodeThreadsOption);
+
+  QCommandLineOption encodeThreadsOption(QStringList() << "encode-threads",
+          "Annotate and save result images on <threads> threads, behind detection.",
+          "threads",
+          "1");
+  parser.addOption(encodeThreadsOption);
+
   QCommandLineOption verboseOption(QStringList() << "v" << "verbose",
           "Verbose output.");
   parser.addOption(verboseOption);
 
+  // The text drawn on result images needs fonts, which only a
+  // QGuiApplication provides, so the arguments are looked at before the
+  // application exists, the same way it parses them
+  QStringList arguments;
+  for (int i = 0; i < argc; ++i) {
+    arguments << QString::fromLocal8Bit(argv[i]);
+  }
+  parser.parse(arguments);
+  bool guiApplication(parser.isSet(resultFileOption));
+
+  QElapsedTimer startup;
+  startup.start();
+  QScopedPointer<QCoreApplication> application;
+  if (guiApplication) {
+    // No display is needed to draw on images
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+      qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    application.reset(new QGuiApplication(argc, argv));
+  } else {
+    application.reset(new QCoreApplication(argc, argv));
+  }
+  QCoreApplication& a(*application);
+  qint64 startupTime(startup.nsecsElapsed());
+  setlocale(LC_NUMERIC,"C");
+
   parser.process(a);
 
   QString mode = parser.value(modeOption);
@@ -53,24 +217,61 @@ int main(int argc, char *argv[])
   QString resultFile = parser.value(resultFileOption);
   bool colorElimination = parser.isSet(colorEliminationOption);
   bool verbose = parser.isSet(verboseOption);
+  qint64 deadline(-1);
 
   QTextStream out(stdout);
 
-  if (trainingDirectory.isEmpty()) {
-    out << "A training directory is required, give one using --training-directory <directory>." << endl;
+#ifdef DETECTOR_EMBED_MODEL
+  bool builtInModel(true);
+#else
+  bool builtInModel(false);
+#endif
+  if (trainingDirectory.isEmpty() && !parser.isSet(loadModelOption) && !builtInModel) {
+    out << "A training directory or a model is required, give one using --training-directory <directory> or --load-model <file>." << endl;
     return 1;
   }
 
-  if (!QFileInfo(trainingDirectory).isDir()) {
+  if (!trainingDirectory.isEmpty() && !QFileInfo(trainingDirectory).isDir()) {
     out << "The training directory must be a directory." << endl;
     return 2;
   }
 
-  if (targetFile.isEmpty()) {
-    out << "A target file is required, give one using --target-file <file>." << endl;
+  if (targetFile.isEmpty() && !parser.isSet(streamOption) && !parser.isSet(daemonOption)) {
+    out << "A target file, a stream or a daemon is required, give one using --target-file <file>, --stream <file> or --daemon <name>." << endl;
     return 3;
   }
 
+  QSize rawSize;
+  QMap<QString, FrameView::Format> rawFormats(FrameStream::rawFormats());
+  if (parser.isSet(rawSizeOption)) {
+    QStringList dimensions(parser.value(rawSizeOption).split("x"));
+    if (dimensions.size() == 2) {
+      rawSize = QSize(dimensions.at(0).toInt(), dimensions.at(1).toInt());
+    }
+    if (rawSize.isEmpty()) {
+      out << "The raw frame size must be given as <width>x<height>." << endl;
+      return 4;
+    }
+  }
+  if (!rawFormats.contains(parser.value(rawFormatOption))) {
+    out << "Unknown raw frame format, use rgb24, bgr24, rgba32, argb32, gray8 or nv12." << endl;
+    return 5;
+  }
+
+  if (parser.value(formatOption) != "text" && parser.value(formatOption) != "jsonl") {
+    out << "Unknown format, use text or jsonl." << endl;
+    return 6;
+  }
+
+  if (parser.isSet(deadlineOption)) {
+    bool ok(false);
+    deadline = parser.value(deadlineOption).toLongLong(&ok);
+    if (!ok || deadline < 0) {
+      out << "The deadline must be given as a number of milliseconds." << endl;
+      return 8;
+    }
+  }
+
   DetectorTask *task = new DetectorTask(&a);
   task->setMode(mode);
   task->setTrainingDirectory(trainingDirectory);
@@ -78,6 +279,47 @@ int main(int argc, char *argv[])
   task->setResultFile(resultFile);
   task->setColorElimination(colorElimination);
   task->setVerbose(verbose);
+  task->setDeadline(deadline);
+  task->setRTablePruning(parser.value(rTableCapOption).toInt(), parser.value(rTableMergeOption).toDouble());
+  task->setDensityFilter(parser.value(edgeDensityOption).toDouble(), parser.value(redDensityOption).toDouble());
+  task->setRedProposals(parser.isSet(redProposalsOption));
+  task->setPreprocessThreads(parser.value(preprocessThreadsOption).toInt());
+  task->setBlurSigma(parser.value(blurSigmaOption).toDouble());
+  if (parser.value(trainingThreadsOption).toInt() > 0) {
+    task->setTrainingThreads(parser.value(trainingThreadsOption).toInt());
+  }
+  task->setJobs(parser.value(jobsOption).toInt());
+  task->setStreamFile(parser.value(streamOption));
+  task->setDaemon(parser.value(daemonOption));
+  task->setFormat(parser.value(formatOption));
+  task->setMetricsFile(parser.value(metricsOption));
+  task->setTraceFile(parser.value(traceOption));
+  if (parser.isSet(trackOption) && parser.isSet(streamOption)) {
+    task->setTracking(parser.value(trackOption).toInt());
+  }
+  if (parser.isSet(tileOption)) {
+    bool ok(false);
+    int tileSize(parser.value(tileOption).toInt(&ok));
+    if (!ok || tileSize < task->minimumTileSize()) {
+      out << QString("The tile size must be at least %1 pixels.").arg(task->minimumTileSize()) << endl;
+      return 7;
+    }
+    task->setTiledDetection(tileSize, parser.value(tileSignsOption).toInt());
+  }
+  if (parser.isSet(incrementalOption) && parser.isSet(streamOption)) {
+    task->setIncremental(parser.value(incrementalOption).toInt());
+  }
+  task->setPipelineThreads(parser.value(decodeThreadsOption).toInt(), parser.value(encodeThreadsOption).toInt());
+  task->setLoadModelFile(parser.value(loadModelOption));
+  task->setSaveModelFile(parser.value(saveModelOption));
+  if (rawSize.isValid()) {
+    task->setRawFrame(rawSize, rawFormats.value(parser.value(rawFormatOption)));
+  }
+
+  // Through the task, which keeps stdout for the records when asked to
+  task->on_issueTiming(QString("Start %1: %2 ms").arg(
+                         guiApplication ? "QGuiApplication" : "QCoreApplication").arg(
+                         startupTime / 1000000.0, 0, 'f', 2));
 
   QObject::connect(task, SIGNAL(finished()), &a, SLOT(quit()));
 
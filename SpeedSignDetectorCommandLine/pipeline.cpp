@@ -0,0 +1,182 @@
+#include "pipeline.h"
+
+// Qt Includes
+#include <QElapsedTimer>
+
+FrameQueue::FrameQueue(int capacity, int producers) :
+  capacity_(qMax(capacity, 1)),
+  producers_(producers),
+  pushes_(0),
+  depthSum_(0),
+  maxDepth_(0),
+  pushStall_(0),
+  popStall_(0)
+{
+
+}
+
+void FrameQueue::push(QSharedPointer<BatchFrame> frame)
+{
+  QMutexLocker locker(&mutex_);
+  if (frames_.size() >= capacity_) {
+    QElapsedTimer stall;
+    stall.start();
+    while (frames_.size() >= capacity_) {
+      notFull_.wait(&mutex_);
+    }
+    pushStall_ += stall.elapsed();
+  }
+  frames_.enqueue(frame);
+
+  pushes_++;
+  depthSum_ += frames_.size();
+  maxDepth_ = qMax(maxDepth_, frames_.size());
+  notEmpty_.wakeOne();
+}
+
+/*
+ * Returns the next frame, or a null frame once the queue is empty and all
+ * producers are done.
+ * */
+QSharedPointer<BatchFrame> FrameQueue::pop()
+{
+  QMutexLocker locker(&mutex_);
+  if (frames_.isEmpty() && producers_ > 0) {
+    QElapsedTimer stall;
+    stall.start();
+    while (frames_.isEmpty() && producers_ > 0) {
+      notEmpty_.wait(&mutex_);
+    }
+    popStall_ += stall.elapsed();
+  }
+  if (frames_.isEmpty()) {
+    return QSharedPointer<BatchFrame>();
+  }
+  QSharedPointer<BatchFrame> frame(frames_.dequeue());
+  notFull_.wakeOne();
+  return frame;
+}
+
+void FrameQueue::producerDone()
+{
+  QMutexLocker locker(&mutex_);
+  producers_--;
+  if (producers_ == 0) {
+    notEmpty_.wakeAll();
+  }
+}
+
+/*
+ * Depth as seen right after each push, and the time producers waited for
+ * room and consumers waited for frames, summed over their threads.
+ * */
+QString FrameQueue::statistics(QString name)
+{
+  QMutexLocker locker(&mutex_);
+  return QString("%1 queue: capacity %2, average depth %3, maximum depth %4, producers stalled %5 ms, consumers stalled %6 ms").arg(
+        name).arg(
+        capacity_).arg(
+        pushes_ > 0 ? double(depthSum_) / pushes_ : 0, 0, 'f', 1).arg(
+        maxDepth_).arg(
+        pushStall_).arg(
+        popStall_);
+}
+
+/*
+ * Each queue holds up to two frames per consumer, enough to keep them busy
+ * while a producer is slow for a frame.
+ * */
+Pipeline::Pipeline(QStringList targetFiles, QStringList resultFiles, int decoders, int workers, int encoders) :
+  targetFiles_(targetFiles),
+  resultFiles_(resultFiles),
+  next_(0),
+  decoded_(2 * workers, decoders),
+  detected_(2 * encoders, workers),
+  finished_(targetFiles.size())
+{
+
+}
+
+int Pipeline::size() const
+{
+  return targetFiles_.size();
+}
+
+/*
+ * Works on the given stage until there are no more frames for it, then lets
+ * the next stage know.
+ * */
+void Pipeline::run(Stage stage, BatchStage* worker)
+{
+  QSharedPointer<BatchFrame> frame;
+  int file;
+  QElapsedTimer timer;
+  switch (stage) {
+  case Decode:
+    while ((file = next_.fetchAndAddOrdered(1)) < targetFiles_.size()) {
+      frame = QSharedPointer<BatchFrame>(new BatchFrame());
+      frame->index_ = file;
+      frame->file_ = targetFiles_.at(file);
+      frame->resultFile_ = resultFiles_.at(file);
+      timer.start();
+      worker->process(frame.data());
+      frame->stageTimes_.insert("decode", timer.nsecsElapsed() / 1000000.0);
+      decoded_.push(frame);
+    }
+    decoded_.producerDone();
+    break;
+  case Detect:
+    while (!(frame = decoded_.pop()).isNull()) {
+      timer.start();
+      worker->process(frame.data());
+      frame->stageTimes_.insert("detect", timer.nsecsElapsed() / 1000000.0);
+      detected_.push(frame);
+    }
+    detected_.producerDone();
+    break;
+  case Encode:
+    while (!(frame = detected_.pop()).isNull()) {
+      timer.start();
+      worker->process(frame.data());
+      frame->stageTimes_.insert("encode", timer.nsecsElapsed() / 1000000.0);
+
+      QMutexLocker locker(&mutex_);
+      finished_[frame->index_] = frame;
+      reportDone_.wakeAll();
+    }
+    break;
+  }
+}
+
+/*
+ * Waits for a file to go through all stages and hands over its frame, with
+ * the report and findings.
+ * */
+QSharedPointer<BatchFrame> Pipeline::takeFrame(int file)
+{
+  QMutexLocker locker(&mutex_);
+  while (finished_.at(file).isNull()) {
+    reportDone_.wait(&mutex_);
+  }
+  QSharedPointer<BatchFrame> frame(finished_.at(file));
+  finished_[file].clear();
+  return frame;
+}
+
+QString Pipeline::statistics()
+{
+  return decoded_.statistics("Decode to detect") + "\n" + detected_.statistics("Detect to encode");
+}
+
+PipelineTask::PipelineTask(QSharedPointer<Pipeline> pipeline, Pipeline::Stage stage, BatchStage* worker) :
+  pipeline_(pipeline),
+  stage_(stage),
+  worker_(worker)
+{
+
+}
+
+void PipelineTask::run()
+{
+  pipeline_->run(stage_, worker_);
+}
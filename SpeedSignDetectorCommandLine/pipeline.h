@@ -0,0 +1,92 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Qt Includes
+#include <QAtomicInt>
+#include <QMutex>
+#include <QQueue>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
+#include <QWaitCondition>
+
+// SpeedSignDetector Includes
+#include "batchworker.h"
+
+/*
+ * Passes frames from one stage to the next. Producers wait while the queue
+ * is full, so frames can not pile up in front of a slow stage, and consumers
+ * wait while it is empty. The time spent waiting tells which stage holds up
+ * the others.
+ * */
+class FrameQueue
+{
+public:
+  FrameQueue(int capacity, int producers);
+
+  void push(QSharedPointer<BatchFrame> frame);
+  QSharedPointer<BatchFrame> pop();
+  void producerDone();
+
+  QString statistics(QString name);
+
+private:
+  QMutex mutex_;
+  QWaitCondition notFull_;
+  QWaitCondition notEmpty_;
+  QQueue<QSharedPointer<BatchFrame> > frames_;
+  int capacity_;
+  int producers_;
+
+  qint64 pushes_;
+  qint64 depthSum_;
+  int maxDepth_;
+  qint64 pushStall_;
+  qint64 popStall_;
+};
+
+/*
+ * Runs the target files through decoding, detection and encoding, each
+ * stage on threads of its own, connected by bounded queues. The finished
+ * frames are kept until they are taken in the order of the files.
+ * */
+class Pipeline
+{
+public:
+  enum Stage { Decode, Detect, Encode };
+
+  Pipeline(QStringList targetFiles, QStringList resultFiles, int decoders, int workers, int encoders);
+
+  int size() const;
+  void run(Stage stage, BatchStage* worker);
+  QSharedPointer<BatchFrame> takeFrame(int file);
+  QString statistics();
+
+private:
+  QStringList targetFiles_;
+  QStringList resultFiles_;
+  QAtomicInt next_;
+
+  FrameQueue decoded_;
+  FrameQueue detected_;
+
+  QMutex mutex_;
+  QWaitCondition reportDone_;
+  QVector<QSharedPointer<BatchFrame> > finished_;
+};
+
+class PipelineTask : public QRunnable
+{
+public:
+  PipelineTask(QSharedPointer<Pipeline> pipeline, Pipeline::Stage stage, BatchStage* worker);
+
+  void run();
+
+private:
+  QSharedPointer<Pipeline> pipeline_;
+  Pipeline::Stage stage_;
+  BatchStage* worker_;
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,72 @@
+// Qt Includes
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QFileInfo>
+
+// Detector Includes
+#include "detector_context.h"
+#include "model_file.h"
+
+/*
+ * Trains on a training directory and writes the model as C++ source, for
+ * building it into the DetectorEmbeddedModel library.
+ * */
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+  setlocale(LC_NUMERIC,"C");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Speed Sign Detector Model Compiler");
+  parser.addHelpOption();
+  parser.addPositionalArgument("trainingDirectory", "Directory with the training images.");
+  parser.addPositionalArgument("source", "C++ source file to write.");
+
+  QCommandLineOption modeOption(QStringList() << "m" << "mode",
+          "Train for <mode> \"Edge\" or \"Harris\".",
+          "mode",
+          "Edge");
+  parser.addOption(modeOption);
+
+  parser.process(a);
+
+  QTextStream out(stdout);
+
+  QStringList arguments(parser.positionalArguments());
+  if (arguments.size() != 2) {
+    out << "A training directory and a source file are required." << endl;
+    return 1;
+  }
+
+  QString trainingDirectory(arguments.at(0));
+  if (!QFileInfo(trainingDirectory).isDir()) {
+    out << "The training directory must be a directory." << endl;
+    return 2;
+  }
+  if (!trainingDirectory.endsWith("/")) {
+    trainingDirectory += "/";
+  }
+
+  DetectorContext context;
+  context.initialize();
+  if (parser.value(modeOption) == "Harris") {
+    context.trainHarris(trainingDirectory);
+  } else {
+    context.train(trainingDirectory);
+  }
+
+  if (context.model()->entries() == 0) {
+    out << QString("No R-table entries found in %1").arg(trainingDirectory) << endl;
+    return 3;
+  }
+
+  QString error;
+  if (!ModelFile::saveSource(*context.model(), arguments.at(1), &error)) {
+    out << error << endl;
+    return 4;
+  }
+
+  out << QString("Wrote %1 R-table entries to %2").arg(context.model()->entries()).arg(arguments.at(1)) << endl;
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Qt Includes
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QColor>
+
+// Detector Includes
+#include "detector.h"
+#include "detection_result.h"
+
+/*
+ * Sweeps the R-table bin size cap, and for each cap trains on the training
+ * directory and tries to classify the training images themselves, scaled
+ * down to typical sign sizes and placed on an empty frame.
+ * */
+
+QImage testFrame(QImage sign, int signSize)
+{
+  QImage frame(600, 600, QImage::Format_RGB32);
+  frame.fill(QColor(90, 90, 90));
+
+  QImage scaledSign(sign.scaled(signSize, signSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+  QPainter painter(&frame);
+  painter.drawImage(QPoint(250, 200), scaledSign);
+  painter.end();
+
+  return frame;
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+  setlocale(LC_NUMERIC,"C");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Speed Sign Detector R-table Pruning Report");
+  parser.addHelpOption();
+
+  QCommandLineOption trainingDirectoryOption(QStringList() << "t" << "training-directory",
+          "Use <trainingDirectory> for training and as the test set.",
+          "trainingDirectory");
+  parser.addOption(trainingDirectoryOption);
+
+  QCommandLineOption capsOption(QStringList() << "c" << "caps",
+          "Comma separated list of R-table bin size <caps> to sweep, 0 means no cap.",
+          "caps",
+          "0,400,200,100,50,25");
+  parser.addOption(capsOption);
+
+  QCommandLineOption mergeDistanceOption(QStringList() << "m" << "merge-distance",
+          "Merge displacement vectors that share a grid cell of <distance> by <distance> pixels, 0 disables merging.",
+          "distance",
+          "0");
+  parser.addOption(mergeDistanceOption);
+
+  QCommandLineOption signSizesOption(QStringList() << "s" << "sign-sizes",
+          "Comma separated list of sign <sizes> in pixels to test at.",
+          "sizes",
+          "24,36,48");
+  parser.addOption(signSizesOption);
+
+  parser.process(a);
+
+  QString trainingDirectory = parser.value(trainingDirectoryOption);
+  double mergeDistance = parser.value(mergeDistanceOption).toDouble();
+
+  QTextStream out(stdout);
+
+  if (!QFileInfo(trainingDirectory).isDir()) {
+    out << "A training directory is required, give one using --training-directory <directory>." << endl;
+    return 1;
+  }
+
+  QList<int> caps;
+  foreach (QString c, parser.value(capsOption).split(",")) {
+    caps << c.toInt();
+  }
+  QList<int> signSizes;
+  foreach (QString s, parser.value(signSizesOption).split(",")) {
+    signSizes << s.toInt();
+  }
+
+  out << QString("%1 %2 %3 %4 %5 %6").arg(
+           "Cap", 6).arg(
+           "Merge", 6).arg(
+           "Entries", 9).arg(
+           "Votes cast", 12).arg(
+           "Time (ms)", 10).arg(
+           "Accuracy", 14) << endl;
+
+  foreach (int cap, caps) {
+    Detector detector;
+    detector.initialize();
+    detector.setRTablePruning(cap, mergeDistance);
+    detector.train(trainingDirectory);
+    detector.resetVotesCast();
+
+    int correct(0);
+    int total(0);
+    qint64 elapsed(0);
+    QElapsedTimer timer;
+
+    foreach (Detector::Speed speed, detector.speeds_.keys()) {
+      if (speed == Detector::NoSpeed) {
+        continue;
+      }
+      QImage sign(trainingDirectory + "training-" + detector.speeds_.value(speed) + ".png");
+      foreach (int signSize, signSizes) {
+        detector.setImage(testFrame(sign, signSize));
+
+        timer.start();
+        DetectionResult result(detector.detectWithin(false, -1));
+        elapsed += timer.elapsed();
+
+        if (result.speed_ == speed) {
+          correct++;
+        }
+        total++;
+      }
+    }
+
+    out << QString("%1 %2 %3 %4 %5 %6").arg(
+             cap, 6).arg(
+             mergeDistance, 6).arg(
+             detector.rTableEntries(), 9).arg(
+             detector.votesCast(), 12).arg(
+             elapsed, 10).arg(
+             QString("%1/%2 (%3%)").arg(correct).arg(total).arg(100.0 * correct / total, 0, 'f', 1), 14) << endl;
+  }
+
+  return 0;
+}
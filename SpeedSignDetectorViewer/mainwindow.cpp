@@ -6,6 +6,7 @@
 #include <QLabel>
 #include <QDebug>
 #include <QGraphicsTextItem>
+#include <QPixmap>
 
 MainWindow::MainWindow(QWidget *parent) :
   QMainWindow(parent),
@@ -53,7 +54,7 @@ void MainWindow::on_actionLoad_Image_triggered()
   }
   detector_.loadImage(fileName);
   scene_.clear();
-  scene_.addPixmap(detector_.getPixmap());
+  scene_.addPixmap(QPixmap::fromImage(detector_.image()));
   scene_.setSceneRect(detector_.getImageSize());
 
   ui->actionBlur->setEnabled(true);
@@ -117,7 +118,7 @@ void MainWindow::on_itemFound(QRect position, int confidence, int order)
 void MainWindow::refetchImage()
 {
   scene_.clear();
-  scene_.addPixmap(detector_.getPixmap());
+  scene_.addPixmap(QPixmap::fromImage(detector_.image()));
 }
 
 void MainWindow::on_actionReset_triggered()
@@ -147,7 +148,7 @@ void MainWindow::on_actionShowAngles_triggered(bool on)
 {
   if (on) {
     scene_.clear();
-    scene_.addPixmap(detector_.getSobelAnglePixmap());
+    scene_.addPixmap(QPixmap::fromImage(detector_.sobelAngleImage()));
   } else {
     refetchImage();
   }